@@ -24,16 +24,28 @@
 
 #include <CommonTypes.hxx>
 
+#include <atomic>
+#include <cassert>
+#include <chrono>
 #include <type_traits>
 #include <cstdlib>
 #include <limits>
 #include <memory>
+#ifdef _WIN32
+#	include <malloc.h>
+#endif
 	
 #ifdef DEBUG
 #	define MEMORY_DEBUG true
 #else
 #	define MEMORY_DEBUG false
 #endif // DEBUG	
+
+#ifdef ALLOCATOR_STATS
+#	define MEMORY_STATS true
+#else
+#	define MEMORY_STATS false
+#endif // ALLOCATOR_STATS
 	
 // Some helper to simplify building of Allocator (even standards ones)
 // @Note : why did I not make the IStdAllocationPolicy a true interface with virtual allocate and deallocate functions ?
@@ -45,6 +57,36 @@
 
 constexpr const char* defaultAllocatorName = "unknown";
 
+// Alignment guaranteed by the memory an allocation policy returns.
+// A policy can advertise a stronger one (mmap gives whole pages for instance) with a static blockAlignment member,
+// so that pools drawing their blocks from it don't have to pad them
+template<typename...>
+struct VoidOf
+{
+	typedef void type;
+};
+
+template<class Policy, class = void>
+struct BlockAlignmentOf : std::integral_constant<uint64, alignof(std::max_align_t)>
+{};
+
+template<class Policy>
+struct BlockAlignmentOf<Policy, typename VoidOf<decltype(Policy::blockAlignment)>::type> 
+	: std::integral_constant<uint64, Policy::blockAlignment>
+{};
+
+// A policy can also hand out memory aligned on any power of two with allocateAligned(size, alignment),
+// given back with deallocateAligned(ptr, size). Pools needing more than blockAlignment use it when it's there,
+// and pad their blocks otherwise
+template<class Policy, class = void>
+struct HasAlignedAllocation : std::false_type
+{};
+
+template<class Policy>
+struct HasAlignedAllocation<Policy, typename VoidOf<decltype(std::declval<Policy&>().allocateAligned(1, 1))>::type> 
+	: std::true_type
+{};
+
 template<typename T, template<class...> class DerivedPolicy>
 class StlAllocationPolicy
 {
@@ -67,14 +109,14 @@ class StlAllocationPolicy
 	
 	//template<typename U>
 	//constexpr bool Equals(const DerivedPolicy<U>& ref) const{return static_cast<DerivedPolicy<T>>(this)->Equals(ref);}
-	template<typename T1, typename T2>
-	friend bool operator ==(const DerivedPolicy<T1>& lhs, const DerivedPolicy<T2>& rhs)
+	template<typename U>
+	friend bool operator ==(const DerivedPolicy<T>& lhs, const DerivedPolicy<U>& rhs)
 	{
 		return lhs.equals(rhs);
 	}
 	
-	template<typename T1, typename T2>
-	friend bool operator !=(const DerivedPolicy<T1>& lhs, const DerivedPolicy<T2>& rhs)
+	template<typename U>
+	friend bool operator !=(const DerivedPolicy<T>& lhs, const DerivedPolicy<U>& rhs)
 	{
 		return !(lhs == rhs);
 	}
@@ -111,6 +153,47 @@ class StlAllocationPolicy
 // Easier to read, easier to implement, good for soul !
 // This type is the default type for almost all container and allocators
 
+// Memory aligned on any power of two, given back with freeAligned. The platform does it when it can,
+// otherwise we over-allocate and keep what malloc returned right before the aligned address
+inline void* mallocAligned(std::size_t bytes, std::size_t alignment)
+{
+	alignment = alignment > sizeof(void*) ? alignment : sizeof(void*);
+#	if defined(_WIN32)
+	void* ptr = _aligned_malloc(bytes, alignment);
+#	elif defined(__unix__) || defined(__APPLE__)
+	void* ptr = nullptr;
+	if(posix_memalign(&ptr, alignment, bytes) != 0)
+	{
+		ptr = nullptr;
+	}
+#	else
+	void* ptr = nullptr;
+	void* raw = std::malloc(bytes + alignment + sizeof(void*));
+	if(raw != nullptr)
+	{
+		uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) + sizeof(void*) + alignment - 1) & ~uintptr_t(alignment - 1);
+		ptr = reinterpret_cast<void*>(aligned);
+		static_cast<void**>(ptr)[-1] = raw;
+	}
+#	endif
+	assert(ptr != nullptr);
+	return ptr;
+}
+
+inline void freeAligned(void* ptr)
+{
+#	if defined(_WIN32)
+	_aligned_free(ptr);
+#	elif defined(__unix__) || defined(__APPLE__)
+	std::free(ptr);
+#	else
+	if(ptr != nullptr)
+	{
+		std::free(static_cast<void**>(ptr)[-1]);
+	}
+#	endif
+}
+
 // WARNING : Although an AllocationPolicy can have multiple template arguments, appart from the type, 
 // every other should have default value !
 template<typename T>
@@ -129,6 +212,14 @@ class DefaultAllocationPolicy
 	{
 		operator delete[](ptr);
 	}
+	T* allocateAligned(allocation_size_type size, uint64 alignment)
+	{
+		return static_cast<T*>(mallocAligned(size * sizeof(T), alignment));
+	}
+	void deallocateAligned(T* ptr, allocation_size_type size)
+	{
+		freeAligned(ptr);
+	}
 	void construct(T* ptr, const T& ref)
 	{
 		new(ptr) T(ref); 
@@ -171,17 +262,410 @@ class DebugAllocatorPolicy
 	protected:
 	const char* name_;
 };
+
+constexpr uint32 latencyBucketCount = 32;
+
+// What a pool looks like at some point, handed to the snapshot hook.
+// Latencies are sampled, bucket i counting the calls that took less than 2^i ns (and at least 2^(i-1)).
+// blocks_, capacity_ and freeListLength_ are only known for pools (policies with getBlockCount), 0 otherwise
+struct AllocatorSnapshot
+{
+	const char* name_;
+	uint64 objectBytes_;
+	uint64 allocations_;
+	uint64 deallocations_;
+	uint64 live_;
+	uint64 peak_;
+	uint64 growths_;
+	uint64 blocks_;
+	uint64 capacity_;
+	uint64 freeListLength_;
+	double fragmentation_; // Part of the nodes handed out at least once that are now sitting in the free list
+	uint64 allocateLatency_[latencyBucketCount];
+	uint64 deallocateLatency_[latencyBucketCount];
+};
+
+typedef void (*SnapshotHook)(const AllocatorSnapshot& snapshot);
+
+// One hook for the whole process, every allocator exports through it (see Allocator::exportSnapshot)
+inline SnapshotHook& snapshotHook()
+{
+	static SnapshotHook hook = nullptr;
+	return hook;
+}
+
+inline void setSnapshotHook(SnapshotHook hook)
+{
+	snapshotHook() = hook;
+}
+
+class NoStatsAllocatorPolicy
+{
+	public:
+	static constexpr bool enabled = false;
+	
+	bool shouldSample(){ return false; }
+	void recordAllocation(allocation_size_type count, uint64 blocksBefore, uint64 blocksAfter){}
+	void recordDeallocation(allocation_size_type count){}
+	void recordAllocateLatency(uint64 nanoseconds){}
+	void recordDeallocateLatency(uint64 nanoseconds){}
+	void fillCounters(AllocatorSnapshot& snapshot) const{}
+};
+
+// Counters are plain integers by default, which is fine for the single threaded pools.
+// With std::atomic<uint64> they can be shared between threads, but every call then writes the same cache lines,
+// allocators shared between threads rather want ShardedStatsAllocatorPolicy (see ConcurrentMemoryPoolAllocator).
+// One call out of samplingPeriod is timed, 0 disables latency histograms altogether
+template<typename Counter = uint64,
+         uint32 samplingPeriod = 64>
+class StatsAllocatorPolicy
+{
+	public:
+	static constexpr bool enabled = true;
+	
+	StatsAllocatorPolicy()
+	: allocations_(0),
+	  deallocations_(0),
+	  peak_(0),
+	  growths_(0),
+	  ticks_(0)
+	{
+		for(uint32 i = 0; i < latencyBucketCount; ++i)
+		{
+			allocateLatency_[i] = 0;
+			deallocateLatency_[i] = 0;
+		}
+	}
+	
+	// Copies written by hand, std::atomic counters can't be copied
+	StatsAllocatorPolicy(const StatsAllocatorPolicy& other)
+	: allocations_(uint64(other.allocations_)),
+	  deallocations_(uint64(other.deallocations_)),
+	  peak_(uint64(other.peak_)),
+	  growths_(uint64(other.growths_)),
+	  ticks_(0)
+	{
+		for(uint32 i = 0; i < latencyBucketCount; ++i)
+		{
+			allocateLatency_[i] = uint64(other.allocateLatency_[i]);
+			deallocateLatency_[i] = uint64(other.deallocateLatency_[i]);
+		}
+	}
+	
+	StatsAllocatorPolicy& operator=(const StatsAllocatorPolicy& other)
+	{
+		allocations_ = uint64(other.allocations_);
+		deallocations_ = uint64(other.deallocations_);
+		peak_ = uint64(other.peak_);
+		growths_ = uint64(other.growths_);
+		for(uint32 i = 0; i < latencyBucketCount; ++i)
+		{
+			allocateLatency_[i] = uint64(other.allocateLatency_[i]);
+			deallocateLatency_[i] = uint64(other.deallocateLatency_[i]);
+		}
+		return *this;
+	}
+	
+	bool shouldSample()
+	{
+		return samplingPeriod != 0 && ++ticks_ % samplingPeriod == 0;
+	}
+	
+	// The block count going up during the call means the pool had to grow on this one
+	// (blocks the pool started with, or got back by a trim, are not growths)
+	void recordAllocation(allocation_size_type count, uint64 blocksBefore, uint64 blocksAfter)
+	{
+		allocations_ += count;
+		uint64 deallocations = deallocations_;
+		uint64 allocations = allocations_;
+		raiseTo(peak_, allocations > deallocations ? allocations - deallocations : 0);
+		growths_ += blocksAfter > blocksBefore;
+	}
+	
+	void recordDeallocation(allocation_size_type count)
+	{
+		deallocations_ += count;
+	}
+	
+	void recordAllocateLatency(uint64 nanoseconds)
+	{
+		++allocateLatency_[bucketOf(nanoseconds)];
+	}
+	
+	void recordDeallocateLatency(uint64 nanoseconds)
+	{
+		++deallocateLatency_[bucketOf(nanoseconds)];
+	}
+	
+	void fillCounters(AllocatorSnapshot& snapshot) const
+	{
+		snapshot.allocations_ = allocations_;
+		snapshot.deallocations_ = deallocations_;
+		snapshot.live_ = snapshot.allocations_ - snapshot.deallocations_;
+		snapshot.peak_ = peak_;
+		snapshot.growths_ = growths_;
+		for(uint32 i = 0; i < latencyBucketCount; ++i)
+		{
+			snapshot.allocateLatency_[i] = allocateLatency_[i];
+			snapshot.deallocateLatency_[i] = deallocateLatency_[i];
+		}
+	}
+	
+	private:
+	static uint32 bucketOf(uint64 nanoseconds)
+	{
+		uint32 bucket = nanoseconds == 0 ? 0 : 64 - __builtin_clzll(nanoseconds);
+		return bucket < latencyBucketCount ? bucket : latencyBucketCount - 1;
+	}
+	
+	static void raiseTo(uint64& peak, uint64 value)
+	{
+		if(value > peak)
+		{
+			peak = value;
+		}
+	}
+	
+	// Load then store could move the peak backwards when another thread raised it in between
+	static void raiseTo(std::atomic<uint64>& peak, uint64 value)
+	{
+		uint64 seen = peak.load(std::memory_order_relaxed);
+		while(value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+		{}
+	}
+	
+	protected:
+	Counter allocations_;
+	Counter deallocations_;
+	Counter peak_;
+	Counter growths_;
+	Counter ticks_;
+	Counter allocateLatency_[latencyBucketCount];
+	Counter deallocateLatency_[latencyBucketCount];
+};
+
+// Same counters for allocators shared between threads. Each thread counts in its own shard (one cache line or more,
+// threads only share one when there are more of them than shards), and snapshots sum the shards up.
+// The live count is only known by summing too, so the peak is refreshed every peakPeriod allocations of a thread
+// and when taking a snapshot : a spike shorter than that can be missed
+template<uint32 samplingPeriod = 64,
+         uint32 shardCount = 16>
+class ShardedStatsAllocatorPolicy
+{
+	public:
+	static constexpr bool enabled = true;
+	static constexpr uint64 peakPeriod = 64;
+	
+	ShardedStatsAllocatorPolicy()
+	: peak_(0),
+	  blockCount_(0)
+	{
+		for(Shard_& e : shards_)
+		{
+			e.clear();
+		}
+	}
+	
+	ShardedStatsAllocatorPolicy(const ShardedStatsAllocatorPolicy& other)
+	: peak_(other.peak_.load(std::memory_order_relaxed)),
+	  blockCount_(other.blockCount_.load(std::memory_order_relaxed))
+	{
+		for(uint32 i = 0; i < shardCount; ++i)
+		{
+			shards_[i].copy(other.shards_[i]);
+		}
+	}
+	
+	ShardedStatsAllocatorPolicy& operator=(const ShardedStatsAllocatorPolicy& other)
+	{
+		peak_.store(other.peak_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		blockCount_.store(other.blockCount_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		for(uint32 i = 0; i < shardCount; ++i)
+		{
+			shards_[i].copy(other.shards_[i]);
+		}
+		return *this;
+	}
+	
+	bool shouldSample()
+	{
+		return samplingPeriod != 0 && add(getShard().ticks_, 1) % samplingPeriod == 0;
+	}
+	
+	// Several threads can see the same growth between their before and after counts,
+	// only the one moving blockCount_ up counts it (growth is rare, so this shared line is seldom touched)
+	void recordAllocation(allocation_size_type count, uint64 blocksBefore, uint64 blocksAfter)
+	{
+		Shard_& shard = getShard();
+		uint64 allocations = add(shard.allocations_, count);
+		if(allocations / peakPeriod != (allocations - count) / peakPeriod)
+		{
+			raisePeak(getLive());
+		}
+		
+		if(blocksAfter > blocksBefore)
+		{
+			uint64 seen = blockCount_.load(std::memory_order_relaxed);
+			while(seen < blocksAfter && !blockCount_.compare_exchange_weak(seen, blocksAfter, std::memory_order_relaxed))
+			{}
+			if(seen < blocksAfter)
+			{
+				add(shard.growths_, 1);
+			}
+		}
+	}
+	
+	void recordDeallocation(allocation_size_type count)
+	{
+		add(getShard().deallocations_, count);
+	}
+	
+	void recordAllocateLatency(uint64 nanoseconds)
+	{
+		add(getShard().allocateLatency_[bucketOf(nanoseconds)], 1);
+	}
+	
+	void recordDeallocateLatency(uint64 nanoseconds)
+	{
+		add(getShard().deallocateLatency_[bucketOf(nanoseconds)], 1);
+	}
+	
+	void fillCounters(AllocatorSnapshot& snapshot) const
+	{
+		// Deallocations first, so that the objects they count are already in the allocations
+		for(const Shard_& e : shards_)
+		{
+			snapshot.deallocations_ += e.deallocations_.load(std::memory_order_relaxed);
+		}
+		for(const Shard_& e : shards_)
+		{
+			snapshot.allocations_ += e.allocations_.load(std::memory_order_relaxed);
+			snapshot.growths_ += e.growths_.load(std::memory_order_relaxed);
+			for(uint32 i = 0; i < latencyBucketCount; ++i)
+			{
+				snapshot.allocateLatency_[i] += e.allocateLatency_[i].load(std::memory_order_relaxed);
+				snapshot.deallocateLatency_[i] += e.deallocateLatency_[i].load(std::memory_order_relaxed);
+			}
+		}
+		snapshot.live_ = snapshot.allocations_ > snapshot.deallocations_ ? snapshot.allocations_ - snapshot.deallocations_ : 0;
+		uint64 peak = peak_.load(std::memory_order_relaxed);
+		snapshot.peak_ = snapshot.live_ > peak ? snapshot.live_ : peak;
+	}
+	
+	private:
+	struct alignas(64) Shard_
+	{
+		std::atomic<uint64> allocations_;
+		std::atomic<uint64> deallocations_;
+		std::atomic<uint64> growths_;
+		std::atomic<uint64> ticks_;
+		std::atomic<uint64> allocateLatency_[latencyBucketCount];
+		std::atomic<uint64> deallocateLatency_[latencyBucketCount];
+		
+		void clear()
+		{
+			allocations_ = 0;
+			deallocations_ = 0;
+			growths_ = 0;
+			ticks_ = 0;
+			for(uint32 i = 0; i < latencyBucketCount; ++i)
+			{
+				allocateLatency_[i] = 0;
+				deallocateLatency_[i] = 0;
+			}
+		}
+		
+		void copy(const Shard_& other)
+		{
+			allocations_ = other.allocations_.load(std::memory_order_relaxed);
+			deallocations_ = other.deallocations_.load(std::memory_order_relaxed);
+			growths_ = other.growths_.load(std::memory_order_relaxed);
+			ticks_ = 0;
+			for(uint32 i = 0; i < latencyBucketCount; ++i)
+			{
+				allocateLatency_[i] = other.allocateLatency_[i].load(std::memory_order_relaxed);
+				deallocateLatency_[i] = other.deallocateLatency_[i].load(std::memory_order_relaxed);
+			}
+		}
+	};
+	
+	// Threads are numbered the first time they count something, shards are taken round robin
+	Shard_& getShard()
+	{
+		static std::atomic<uint32> threadCount(0);
+		static thread_local uint32 index = threadCount.fetch_add(1, std::memory_order_relaxed) % shardCount;
+		return shards_[index];
+	}
+	
+	// Relaxed : counters don't order anything, returns the new value
+	static uint64 add(std::atomic<uint64>& counter, uint64 value)
+	{
+		return counter.fetch_add(value, std::memory_order_relaxed) + value;
+	}
+	
+	uint64 getLive() const
+	{
+		uint64 deallocations = 0;
+		uint64 allocations = 0;
+		for(const Shard_& e : shards_)
+		{
+			deallocations += e.deallocations_.load(std::memory_order_relaxed);
+		}
+		for(const Shard_& e : shards_)
+		{
+			allocations += e.allocations_.load(std::memory_order_relaxed);
+		}
+		return allocations > deallocations ? allocations - deallocations : 0;
+	}
+	
+	void raisePeak(uint64 live)
+	{
+		uint64 seen = peak_.load(std::memory_order_relaxed);
+		while(live > seen && !peak_.compare_exchange_weak(seen, live, std::memory_order_relaxed))
+		{}
+	}
+	
+	static uint32 bucketOf(uint64 nanoseconds)
+	{
+		uint32 bucket = nanoseconds == 0 ? 0 : 64 - __builtin_clzll(nanoseconds);
+		return bucket < latencyBucketCount ? bucket : latencyBucketCount - 1;
+	}
+	
+	Shard_ shards_[shardCount];
+	std::atomic<uint64> peak_;
+	std::atomic<uint64> blockCount_; // Highest block count seen, to count each growth once
+};
+
+typedef std::conditional<MEMORY_STATS, StatsAllocatorPolicy<>, NoStatsAllocatorPolicy>::type DefaultStatsPolicy;
+typedef std::conditional<MEMORY_STATS, ShardedStatsAllocatorPolicy<>, NoStatsAllocatorPolicy>::type ConcurrentStatsPolicy;
+
+// Pools tell how many blocks they hold with getBlockCount, used by the stats to spot growth
+template<class Policy, class = void>
+struct IsPoolPolicy : std::false_type
+{};
+
+template<class Policy>
+struct IsPoolPolicy<Policy, typename VoidOf<decltype(std::declval<const Policy&>().getBlockCount())>::type> 
+	: std::true_type
+{};
+
 // Conditionnaly add a name_ field depending on build mod, without #if macros
 // DebugAllocatorPolicy and ReleaseAllocatorPolicy could also be extended
 // A macro would be less code, but I hate macro in C++, I just use them when they're is nothing else to do 
 // (or way too much code to avoid it)
+// Same thing for the statistics : with NoStatsAllocatorPolicy (the default, unless ALLOCATOR_STATS is defined)
+// every bit of bookkeeping is behind a constant false condition and the base is empty, so this is the plain policy.
+// Pools keep their name when stats are on, so that snapshots can be told apart
 template<typename T,
-         class AllocationPolicy = DefaultAllocationPolicy<T>>
+         class AllocationPolicy = DefaultAllocationPolicy<T>,
+         class StatsPolicy = DefaultStatsPolicy>
 class Allocator 
-    : public std::conditional<MEMORY_DEBUG, DebugAllocatorPolicy, ReleaseAllocatorPolicy>::type,
+    : public std::conditional<MEMORY_DEBUG || StatsPolicy::enabled, DebugAllocatorPolicy, ReleaseAllocatorPolicy>::type,
+      public StatsPolicy,
       public AllocationPolicy
 {
-	typedef std::conditional<MEMORY_DEBUG, DebugAllocatorPolicy, ReleaseAllocatorPolicy>::type ConfigPolicy;
+	typedef typename std::conditional<MEMORY_DEBUG || StatsPolicy::enabled, DebugAllocatorPolicy, ReleaseAllocatorPolicy>::type ConfigPolicy;
+	typedef std::chrono::steady_clock Clock;
 	public:
 	// Import constructors from parent class
 	using ConfigPolicy::ConfigPolicy;
@@ -189,12 +673,66 @@ class Allocator
 	
 	T* allocate(allocation_size_type size, const T* hint = nullptr)
 	{
-		return static_cast<AllocationPolicy*>(this)->allocate(size, hint);
+		if(!StatsPolicy::enabled)
+		{
+			return static_cast<AllocationPolicy*>(this)->allocate(size, hint);
+		}
+		
+		T* ptr = nullptr;
+		uint64 blocksBefore = blockCountOf(IsPoolPolicy<AllocationPolicy>());
+		if(StatsPolicy::shouldSample())
+		{
+			Clock::time_point begin = Clock::now();
+			ptr = static_cast<AllocationPolicy*>(this)->allocate(size, hint);
+			StatsPolicy::recordAllocateLatency(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+		}
+		else
+		{
+			ptr = static_cast<AllocationPolicy*>(this)->allocate(size, hint);
+		}
+		StatsPolicy::recordAllocation(size, blocksBefore, blockCountOf(IsPoolPolicy<AllocationPolicy>()));
+		return ptr;
 	}
 	
 	void deallocate(T* ptr, allocation_size_type size)
 	{
-		static_cast<AllocationPolicy*>(this)->deallocate(ptr, size);
+		if(!StatsPolicy::enabled)
+		{
+			static_cast<AllocationPolicy*>(this)->deallocate(ptr, size);
+			return;
+		}
+		
+		if(StatsPolicy::shouldSample())
+		{
+			Clock::time_point begin = Clock::now();
+			static_cast<AllocationPolicy*>(this)->deallocate(ptr, size);
+			StatsPolicy::recordDeallocateLatency(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+		}
+		else
+		{
+			static_cast<AllocationPolicy*>(this)->deallocate(ptr, size);
+		}
+		StatsPolicy::recordDeallocation(size);
+	}
+	
+	// Only for policies having them (pools)
+	void allocateBatch(T** output, allocation_size_type count)
+	{
+		uint64 blocksBefore = StatsPolicy::enabled ? blockCountOf(IsPoolPolicy<AllocationPolicy>()) : 0;
+		static_cast<AllocationPolicy*>(this)->allocateBatch(output, count);
+		if(StatsPolicy::enabled)
+		{
+			StatsPolicy::recordAllocation(count, blocksBefore, blockCountOf(IsPoolPolicy<AllocationPolicy>()));
+		}
+	}
+	
+	void deallocateBatch(T* const* ptrs, allocation_size_type count)
+	{
+		static_cast<AllocationPolicy*>(this)->deallocateBatch(ptrs, count);
+		if(StatsPolicy::enabled)
+		{
+			StatsPolicy::recordDeallocation(count);
+		}
 	}
 	
 	void construct(T* ptr, const T& ref)
@@ -206,12 +744,56 @@ class Allocator
 	{
 		static_cast<AllocationPolicy*>(this)->destroy(ptr);
 	}
+	
+	// Counters are all 0 without stats. The free list is walked, so don't call this on a hot path
+	AllocatorSnapshot getSnapshot() const
+	{
+		AllocatorSnapshot snapshot{};
+		snapshot.name_ = ConfigPolicy::getName();
+		snapshot.objectBytes_ = sizeof(T);
+		StatsPolicy::fillCounters(snapshot);
+		fillPoolSnapshot(snapshot, IsPoolPolicy<AllocationPolicy>());
+		
+		uint64 touched = snapshot.live_ + snapshot.freeListLength_;
+		snapshot.fragmentation_ = touched != 0 ? double(snapshot.freeListLength_) / touched : 0.0;
+		return snapshot;
+	}
+	
+	// Hand a snapshot to the hook set with setSnapshotHook. Does nothing without stats, so it can stay in production code
+	void exportSnapshot() const
+	{
+		if(StatsPolicy::enabled && snapshotHook() != nullptr)
+		{
+			snapshotHook()(getSnapshot());
+		}
+	}
 		
 	template<typename U>
 	struct rebind
 	{
-		typedef Allocator<U, typename AllocationPolicy::template rebind<U>::other> other;
+		typedef Allocator<U, typename AllocationPolicy::template rebind<U>::other, StatsPolicy> other;
 	};
+	
+	private:
+	uint64 blockCountOf(std::true_type isPool) const
+	{
+		return AllocationPolicy::getBlockCount();
+	}
+	
+	uint64 blockCountOf(std::false_type isPool) const
+	{
+		return 0;
+	}
+	
+	void fillPoolSnapshot(AllocatorSnapshot& snapshot, std::true_type isPool) const
+	{
+		snapshot.blocks_ = AllocationPolicy::getBlockCount();
+		snapshot.capacity_ = snapshot.blocks_ * AllocationPolicy::getCapacity();
+		snapshot.freeListLength_ = AllocationPolicy::getFreeCount();
+	}
+	
+	void fillPoolSnapshot(AllocatorSnapshot& snapshot, std::false_type isPool) const
+	{}
 };
 
 
@@ -0,0 +1,464 @@
+#ifndef CONCURRENTMEMORYPOOL
+#define CONCURRENTMEMORYPOOL
+
+/************************************************************************/
+// Internet Software Consortium (ISC) License 
+// Version 1, December 2015 
+// 
+// Copyright (C) 2015 Loic URIEN <urien.loic.cours@gmail.com> 
+// 
+// Permission to use, copy, modify, and/or distribute this software 
+// for any purpose with or without fee is hereby granted, 
+// provided that the above copyright notice and this permission notice 
+// appear in all copies unless the author says otherwise. 
+// 
+// THE SOFTWARE IS PROVIDED "AS IS" 
+// AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE 
+// INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. 
+// IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, 
+// DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER 
+// RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION 
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF 
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE. 
+/************************************************************************/
+
+#include <Allocator.hxx>
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <new>
+#include <unordered_map>
+
+// Thread-safe counterpart of BasicMemoryPoolAllocationPolicy.
+// Each thread keeps a small private free list (its cache), so the hot path of allocate and deallocate
+// never touches shared memory. When the cache runs dry, a whole batch of nodes is popped from a shared
+// lock-free stack ; when it grows too big, a batch is pushed back. Nodes can thus be freed by any thread,
+// they will simply travel back through the shared stack.
+// The shared stack head is a pointer with a 16 bits version tag packed in its upper bits, which is enough
+// to defeat the ABA problem without double-word CAS (user space addresses fit in 48 bits on x86-64 and AArch64).
+// Growth does not hold any lock : the thread that finds everything empty allocates a new block on its own,
+// keeps one batch and publishes the rest, other threads are free to do the same in the meantime.
+template<typename T,
+		 class AllocationPolicy = DefaultAllocationPolicy<T>,
+		 bool aligned = true>
+class ConcurrentMemoryPoolAllocationPolicy
+{
+	protected:
+	union Node_;
+	struct Block_;
+	struct Shared_;
+	struct Cache_;
+	struct ThreadCaches_;
+	typedef typename AllocationPolicy::template rebind<char>::other BlockAllocator;
+
+	public:
+	explicit ConcurrentMemoryPoolAllocationPolicy(allocation_size_type capacity = 4096, allocation_size_type batchSize = 64);
+	ConcurrentMemoryPoolAllocationPolicy(const ConcurrentMemoryPoolAllocationPolicy& other) = delete;
+	ConcurrentMemoryPoolAllocationPolicy(ConcurrentMemoryPoolAllocationPolicy&& other) = default;
+	~ConcurrentMemoryPoolAllocationPolicy() = default;
+
+	ConcurrentMemoryPoolAllocationPolicy& operator=(const ConcurrentMemoryPoolAllocationPolicy& other) = delete;
+	ConcurrentMemoryPoolAllocationPolicy& operator=(ConcurrentMemoryPoolAllocationPolicy&& other) = default;
+
+	T* allocate(allocation_size_type size, const T* hint = nullptr);
+	void deallocate(T* ptr, allocation_size_type size);
+
+	// Give back every node cached by the calling thread to the shared list.
+	// Done automatically when the thread exits, but can be useful before a thread goes idle for a long time
+	void flushThreadCache();
+
+	allocation_size_type getCapacity() const
+	{
+		return shared_->capacity_;
+	}
+
+	allocation_size_type getBatchSize() const
+	{
+		return shared_->batchSize_;
+	}
+
+	protected:
+	Cache_& getThreadCache();
+	void refill(Cache_& cache);
+	void drain(Cache_& cache);
+	Node_* newBlock();
+
+	static Node_* popBatch(Shared_& shared);
+	static void pushBatches(Shared_& shared, Node_* first, Node_* last);
+	static void flush(Shared_& shared, Cache_& cache);
+
+	static uint64 pack(Node_* node, uint64 tag);
+	static Node_* unpack(uint64 head);
+	static uint64 nextTag(uint64 head);
+
+	static uint64 nextPoolId()
+	{
+		static std::atomic<uint64> counter(0);
+		return ++counter;
+	}
+
+	protected:
+	template<typename U>
+	struct rebind
+	{
+		typedef ConcurrentMemoryPoolAllocationPolicy<U, typename AllocationPolicy::template rebind<U>::other, aligned> other;
+	};
+
+	protected:
+	// A batch is a chain of nodes linked by next_. Only the first node of a batch sitting in the shared stack
+	// uses nextBatch_, so nodes need room for two pointers
+	struct Link_
+	{
+		Node_* next_;
+		Node_* nextBatch_;
+	};
+
+	union Node_
+	{
+		Link_ link_;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type value_;
+	};
+
+	struct Block_
+	{
+		Block_* next_;
+	};
+
+	// Everything the threads share. Kept behind a shared_ptr so that a thread exiting after the pool
+	// died doesn't flush its cache into freed memory.
+	// Blocks come from AllocationPolicy rebound to bytes, like the basic pool. Any thread may grow the pool,
+	// so the policy must be safe to call concurrently (the stateless ones of this library are)
+	struct Shared_
+	{
+		Shared_(allocation_size_type capacity, allocation_size_type batchSize);
+		~Shared_();
+
+		std::atomic<uint64> freeBatches_;
+		std::atomic<Block_*> blocks_;
+		allocation_size_type capacity_;
+		allocation_size_type batchSize_;
+		uint64 blockBytes_;
+		uint64 id_;
+		BlockAllocator blockAllocator_;
+	};
+
+	struct Cache_
+	{
+		Node_* head_;
+		allocation_size_type count_; // Only a hint used to decide when to drain, flushed batches may be shorter
+	};
+
+	// Per thread caches of every pool this thread touched, keyed by pool id rather than address,
+	// so a pool reusing the address of a dead one won't pick up stale nodes
+	struct ThreadCaches_
+	{
+		struct Entry_
+		{
+			std::weak_ptr<Shared_> owner_;
+			Cache_ cache_;
+		};
+
+		~ThreadCaches_();
+
+		std::unordered_map<uint64, Entry_> entries_;
+		uint64 lastId_ = 0;
+		Cache_* last_ = nullptr;
+	};
+
+	protected:
+	std::shared_ptr<Shared_> shared_;
+
+	static constexpr uint64 tagShift = sizeof(void*) == 8 ? 48 : 32;
+	static constexpr uint64 pointerMask = (uint64(1) << tagShift) - 1;
+	static constexpr uint64 nodeAlignment = (aligned && alignof(Node_) < sizeof(std::max_align_t)) ? alignof(std::max_align_t) : alignof(Node_);
+};
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::Shared_::Shared_(allocation_size_type capacity, allocation_size_type batchSize)
+: freeBatches_(0),
+  blocks_(nullptr),
+  capacity_(capacity),
+  batchSize_(batchSize),
+  blockBytes_(sizeof(Block_) + nodeAlignment - 1 + capacity * sizeof(Node_)),
+  id_(nextPoolId()),
+  blockAllocator_()
+{}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::Shared_::~Shared_()
+{
+	Block_* block = blocks_.load(std::memory_order_acquire);
+	while(block != nullptr)
+	{
+		Block_* next = block->next_;
+		blockAllocator_.deallocate(reinterpret_cast<char*>(block), blockBytes_);
+		block = next;
+	}
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::ThreadCaches_::~ThreadCaches_()
+{
+	for(auto& e : entries_)
+	{
+		if(auto shared = e.second.owner_.lock())
+		{
+			flush(*shared, e.second.cache_);
+		}
+	}
+}
+
+// The capacity is rounded up to a whole number of batches, so that every batch carved from a block is full
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::ConcurrentMemoryPoolAllocationPolicy(allocation_size_type capacity, allocation_size_type batchSize)
+: shared_()
+{
+	batchSize = batchSize != 0 ? batchSize : 1;
+	capacity = capacity > batchSize ? capacity : batchSize;
+	capacity = ((capacity + batchSize - 1) / batchSize) * batchSize;
+
+	shared_ = std::make_shared<Shared_>(capacity, batchSize);
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+inline uint64 ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::pack(Node_* node, uint64 tag)
+{
+	return (reinterpret_cast<uintptr_t>(node) & pointerMask) | (tag << tagShift);
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+inline typename ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::Node_*
+ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::unpack(uint64 head)
+{
+	return reinterpret_cast<Node_*>(static_cast<uintptr_t>(head & pointerMask));
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+inline uint64 ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::nextTag(uint64 head)
+{
+	return (head >> tagShift) + 1;
+}
+
+// The node we read nextBatch_ from may have been popped and handed to the user by another thread in between.
+// The memory is still ours (blocks live as long as the pool), and the tag makes the CAS fail in that case,
+// we only need the read itself to be atomic
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+typename ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::Node_*
+ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::popBatch(Shared_& shared)
+{
+	uint64 head = shared.freeBatches_.load(std::memory_order_acquire);
+	Node_* batch;
+	while((batch = unpack(head)) != nullptr)
+	{
+		Node_* nextBatch = __atomic_load_n(&batch->link_.nextBatch_, __ATOMIC_RELAXED);
+		if(shared.freeBatches_.compare_exchange_weak(head, pack(nextBatch, nextTag(head)),
+		                                             std::memory_order_acquire, std::memory_order_acquire))
+		{
+			return batch;
+		}
+	}
+	return nullptr;
+}
+
+// Push a list of batches, already linked together through nextBatch_, in a single CAS
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+void ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::pushBatches(Shared_& shared, Node_* first, Node_* last)
+{
+	uint64 head = shared.freeBatches_.load(std::memory_order_relaxed);
+	do
+	{
+		__atomic_store_n(&last->link_.nextBatch_, unpack(head), __ATOMIC_RELAXED);
+	}
+	while(!shared.freeBatches_.compare_exchange_weak(head, pack(first, nextTag(head)),
+	                                                 std::memory_order_release, std::memory_order_relaxed));
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+void ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::flush(Shared_& shared, Cache_& cache)
+{
+	while(cache.head_ != nullptr)
+	{
+		Node_* first = cache.head_;
+		Node_* last = first;
+		for(allocation_size_type i = 1; i < shared.batchSize_ && last->link_.next_ != nullptr; ++i)
+		{
+			last = last->link_.next_;
+		}
+		cache.head_ = last->link_.next_;
+		last->link_.next_ = nullptr;
+		pushBatches(shared, first, first);
+	}
+	cache.count_ = 0;
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+inline typename ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::Cache_&
+ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::getThreadCache()
+{
+	static thread_local ThreadCaches_ caches;
+
+	if(caches.lastId_ == shared_->id_)
+	{
+		return *caches.last_;
+	}
+
+	auto it = caches.entries_.find(shared_->id_);
+	if(it == caches.entries_.end())
+	{
+		// Only place where we can cheaply forget about dead pools
+		for(auto e = caches.entries_.begin(); e != caches.entries_.end();)
+		{
+			e = e->second.owner_.expired() ? caches.entries_.erase(e) : std::next(e);
+		}
+		it = caches.entries_.emplace(shared_->id_, typename ThreadCaches_::Entry_{shared_, Cache_{nullptr, 0}}).first;
+	}
+
+	caches.lastId_ = shared_->id_;
+	caches.last_ = &it->second.cache_;
+	return *caches.last_;
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+typename ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::Node_*
+ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::newBlock()
+{
+	const allocation_size_type capacity = shared_->capacity_;
+	const allocation_size_type batchSize = shared_->batchSize_;
+
+	char* raw = shared_->blockAllocator_.allocate(shared_->blockBytes_);
+	char* start = raw + sizeof(Block_);
+	start += (-reinterpret_cast<uintptr_t>(start)) & (nodeAlignment - 1);
+	Node_* nodes = reinterpret_cast<Node_*>(start);
+
+	for(allocation_size_type i = 0; i < capacity; ++i)
+	{
+		nodes[i].link_.next_ = ((i + 1) % batchSize) != 0 ? &nodes[i + 1] : nullptr;
+	}
+	for(allocation_size_type i = batchSize; i < capacity; i += batchSize)
+	{
+		nodes[i].link_.nextBatch_ = (i + batchSize) < capacity ? &nodes[i + batchSize] : nullptr;
+	}
+
+	Block_* block = reinterpret_cast<Block_*>(raw);
+	block->next_ = shared_->blocks_.load(std::memory_order_relaxed);
+	while(!shared_->blocks_.compare_exchange_weak(block->next_, block, std::memory_order_release, std::memory_order_relaxed));
+
+	// First batch stays with the calling thread, the others go straight to the shared stack
+	if(capacity > batchSize)
+	{
+		pushBatches(*shared_, &nodes[batchSize], &nodes[capacity - batchSize]);
+	}
+	return nodes;
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+void ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::refill(Cache_& cache)
+{
+	Node_* batch = popBatch(*shared_);
+	cache.head_ = batch != nullptr ? batch : newBlock();
+	cache.count_ = shared_->batchSize_;
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+void ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::drain(Cache_& cache)
+{
+	Node_* first = cache.head_;
+	Node_* last = first;
+	allocation_size_type count = 1;
+	for(; count < shared_->batchSize_ && last->link_.next_ != nullptr; ++count)
+	{
+		last = last->link_.next_;
+	}
+	cache.head_ = last->link_.next_;
+	cache.count_ = cache.count_ > count ? cache.count_ - count : 0;
+	last->link_.next_ = nullptr;
+	pushBatches(*shared_, first, first);
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+T* ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::allocate(allocation_size_type size, const T* hint)
+{
+	assert(size == 1); // One node at a time, like the basic pool
+	Cache_& cache = getThreadCache();
+	if(cache.head_ == nullptr)
+	{
+		refill(cache);
+	}
+
+	Node_* returnPtr = cache.head_;
+	cache.head_ = returnPtr->link_.next_;
+	cache.count_ = cache.count_ != 0 ? cache.count_ - 1 : 0;
+	return reinterpret_cast<T*>(returnPtr);
+}
+
+// Same as the basic policy : the destructor is called, memory is not cleared.
+// The node may come from any thread, it lands in the caller's cache anyway
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+void ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::deallocate(T* ptr, allocation_size_type size)
+{
+	assert(size == 1);
+	Cache_& cache = getThreadCache();
+
+	if(!std::is_trivially_destructible<T>::value)
+	{
+		ptr->~T();
+	}
+	Node_* node = reinterpret_cast<Node_*>(ptr);
+	node->link_.next_ = cache.head_;
+	cache.head_ = node;
+
+	if(++cache.count_ >= 2 * shared_->batchSize_)
+	{
+		drain(cache);
+	}
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned>
+void ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::flushThreadCache()
+{
+	flush(*shared_, getThreadCache());
+}
+
+
+// Alias for the thread-safe memory pool allocator
+template<typename T,
+		 class AllocationPolicy = DefaultAllocationPolicy<T>,
+		 bool aligned = true>
+using ConcurrentMemoryPoolAllocator = Allocator<T, ConcurrentMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>, ConcurrentStatsPolicy>;
+
+
+#endif // CONCURRENTMEMORYPOOL
@@ -25,17 +25,40 @@
 #include <Allocator.hxx>
 #include <memory>
 #include <cassert>
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <unordered_set>
 #include <vector>
 
+// Snapshots need mmap and friends, so they live in PoolSnapshot.hxx, to include when saving or restoring pools
+enum class SnapshotMode;
+
+// When lazyInit is set, a fresh block is not threaded into the free list up front. Nodes are handed out
+// with a bump pointer instead, block after block, and only freed nodes ever go to the free list.
+// Memory of a block is then only touched when it is actually used, so big pools (or resize) don't
+// page fault the whole block at once.
+// When trackOccupancy is set, every block starts with a bitmap of its live nodes. Blocks are then aligned on
+// a power of two (blockSpan_), so finding the bitmap of any node is a simple mask. This makes isLive O(1), and
+// allows to visit the live objects without looking at the free list at all. The capacity is grown so that the
+// nodes fill the whole span (getCapacity tells the real one). The alignment comes from the policy's allocateAligned
+// when it has one, otherwise every block is padded with up to a span more memory.
+// Block memory comes from AllocationPolicy (rebound to bytes), so blocks can live in plain heap memory,
+// in anonymous mappings or in huge pages (see PageAllocationPolicy.hxx)
+// Pools of trivially copyable objects can be saved to a file, and mapped back from it later on (see PoolSnapshot.hxx)
 template<typename T, 
 		 class AllocationPolicy = DefaultAllocationPolicy<T>,
-		 bool aligned = true>
+		 bool aligned = true,
+		 bool lazyInit = true,
+		 bool trackOccupancy = false>
 class BasicMemoryPoolAllocationPolicy 
-    : public std::conditional<sizeof(T) < sizeof(T*), typename AllocationPolicy::template rebind<T*>::other, T>::type
+    : protected AllocationPolicy::template rebind<char>::other
 {
 	protected:
 	union Node_;
-	typedef typename AllocationPolicy::template rebind<T*>::other Alloc;
+	typedef typename AllocationPolicy::template rebind<char>::other BlockAllocator;
+	// Occupancy blocks are aligned on blockSpan_ by the policy itself when it can, and padded otherwise
+	typedef std::integral_constant<bool, trackOccupancy && HasAlignedAllocation<BlockAllocator>::value> AlignedBlocks_;
 	
 	public:
 	explicit BasicMemoryPoolAllocationPolicy(allocation_size_type capacity = 4096);
@@ -49,11 +72,49 @@ class BasicMemoryPoolAllocationPolicy
 	T* allocate(allocation_size_type size, const T* hint = nullptr);
 	void deallocate(T* ptr, allocation_size_type size);
 	
+	// Bulk versions, for when objects come and go by the hundreds.
+	// allocateBatch fills output with count nodes, carving them straight from the fresh blocks once the free list is empty.
+	// deallocateBatch splices all the nodes in the free list at once, they don't need to be contiguous
+	void allocateBatch(T** output, allocation_size_type count);
+	void deallocateBatch(T* const* ptrs, allocation_size_type count);
+	
+	// Only available with trackOccupancy
+	bool isLive(const T* ptr) const;
+	
+	// Call f on every live object. Removing the visited object from f is fine.
+	// Without trackOccupancy, we have to collect the free list first, so expect it to be much slower
+	template<typename Function>
+	void forEachLive(Function&& f);
+	
+	// Give the blocks without any live object back to AllocationPolicy, which is when memory returns to the OS
+	// with the mmap based policies. Returns the number of blocks released, always 0 for a read only snapshot.
+	// Blocks after a released one move down, so positions (MemoryPool::operator[], removeAt) are not stable across a trim
+	allocation_size_type trim();
+	
+	// Trivially copyable T only. elementCount is stored along, for MemoryPool size.
+	// restoreSnapshot replaces the content of the pool with a mapping of the file, which must come from a pool
+	// of the same type and capacity. At worst only the pages holding free nodes are written (and so copied) while
+	// restoring, with SnapshotMode::readOnly the whole mapping is then write protected.
+	// Both return false when the file can't be written or read, or doesn't match, the pool being left untouched
+	// Defined in PoolSnapshot.hxx
+	bool saveSnapshot(const char* path, uint64 elementCount = 0) const;
+	bool restoreSnapshot(const char* path, SnapshotMode mode, uint64* elementCount = nullptr);
+	
 	allocation_size_type getCapacity() const
 	{
 		return capacity_;
 	}
 	
+	uint64 getBlockCount() const
+	{
+		return firstNode_.size();
+	}
+	
+	// Walks the free list, mostly there for the statistics
+	uint64 getFreeCount() const;
+	
+	static constexpr bool hasOccupancy = trackOccupancy;
+	
 	private:
 		
 	template<class S, S val>
@@ -72,28 +133,69 @@ class BasicMemoryPoolAllocationPolicy
 	template<bool isAligned = aligned>
 	typename std::enable_if<!isAligned, Node_>::type* newBlock(allocation_size_type size);
 	
+	Node_* reserveBlock(allocation_size_type nodeBytes, uint64 alignment);
+	char* allocateBlockMemory(uint64 alignment, std::true_type);
+	char* allocateBlockMemory(uint64 alignment, std::false_type);
+	void deallocateBlockMemory(void* memory, std::true_type);
+	void deallocateBlockMemory(void* memory, std::false_type);
 	void buildFreeList();
+	Node_* nextFreshBlock();
+	bool isFresh(const T* ptr) const;
+	void releaseBlocks();
+	bool isMapped(const void* memory) const;
+	
+	// Blocks are not sorted by address, this gives them sorted once, so that the block of a node is a binary search away
+	typedef std::vector<std::pair<const Node_*, uint64>> SortedBlocks_;
+	SortedBlocks_ sortBlocks() const;
+	uint64 blockIndexOf(const SortedBlocks_& sortedBlocks, const Node_* node) const;
+	
+	struct SnapshotHeader_;
+	uint64 getSnapshotFlags() const;
+	uint64 getSnapshotStride() const;
+	
+	struct BlockHeader_;
+	BlockHeader_* headerOf(const void* node) const;
+	uint64* bitsOf(BlockHeader_* header) const;
+	allocation_size_type indexOf(const void* node, const BlockHeader_* header) const;
+	void markLive(const void* node);
+	void markFree(const void* node);
 
 	protected:
 	template<typename U>
 	struct rebind
 	{
-		typedef BasicMemoryPoolAllocationPolicy<U, typename AllocationPolicy::template rebind<U>::other> other;
+		typedef BasicMemoryPoolAllocationPolicy<U, typename AllocationPolicy::template rebind<U>::other, aligned, lazyInit, trackOccupancy> other;
 	};
 	
 	protected:
 	union Node_
 	{
-		T* value_;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type value_;
 		Node_* next_;
 	};
 	
+	struct BlockHeader_
+	{
+		allocation_size_type live_; // Followed by the bitmap words
+	};
+	
 	protected:
 	allocation_size_type capacity_;
 	Node_* freeNode_;
 	Node_* currentNode_;
 	std::vector<Node_*> firstNode_;
-	int64 currentBlock_;
+	std::vector<void*> blockMemory_; // What operator new really gave us, firstNode_ may be further
+	int64 currentBlock_; // Block the bump pointer is in, following blocks are still untouched
+	Node_* bumpNode_;
+	Node_* bumpEnd_;
+	uint64 bitmapWords_;
+	uint64 headerBytes_;
+	uint64 blockSpan_;
+	uint64 blockBytes_; // Size asked to BlockAllocator for each block
+	char* mappedBase_; // Restored blocks, they belong to the mapping rather than to BlockAllocator
+	uint64 mappedBytes_;
+	void (*releaseMapping_)(char* base, uint64 bytes); // Set along with the mapping, keeps munmap out of here
+	bool readOnly_;
 	
 	static constexpr uint64 alignement = std::conditional<alignof(T) <= sizeof(std::max_align_t), ValueOf<alignof(T)>, ValueOf<sizeof(std::max_align_t)>>::type::value;
 	
@@ -102,99 +204,282 @@ class BasicMemoryPoolAllocationPolicy
 
 template<typename T,
 		 class AllocationPolicy,
-		 bool aligned>
-BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::BasicMemoryPoolAllocationPolicy(allocation_size_type capacity) 
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::BasicMemoryPoolAllocationPolicy(allocation_size_type capacity) 
 : capacity_(capacity),
   freeNode_(nullptr),
   currentNode_(nullptr),
   currentBlock_(-1),
-  firstNode_()
+  firstNode_(),
+  blockMemory_(),
+  bumpNode_(nullptr),
+  bumpEnd_(nullptr),
+  bitmapWords_(0),
+  headerBytes_(0),
+  blockSpan_(0),
+  blockBytes_(0),
+  mappedBase_(nullptr),
+  mappedBytes_(0),
+  releaseMapping_(nullptr),
+  readOnly_(false)
 {
-	newBlock(capacity);
+	if(trackOccupancy)
+	{
+		const uint64 nodeAlignment = alignof(Node_) > alignement ? alignof(Node_) : alignement;
+		bitmapWords_ = (capacity_ + 63) / 64;
+		headerBytes_ = sizeof(BlockHeader_) + bitmapWords_ * sizeof(uint64);
+		headerBytes_ = (headerBytes_ + nodeAlignment - 1) & ~(nodeAlignment - 1);
+		blockSpan_ = 1;
+		while(blockSpan_ < headerBytes_ + capacity_ * sizeof(Node_))
+		{
+			blockSpan_ <<= 1;
+		}
+		
+		// The block takes the whole span anyway, so fill it with nodes. More nodes may need a bigger bitmap,
+		// so go down from the most the span could hold until header and nodes fit
+		capacity_ = (blockSpan_ - headerBytes_) / sizeof(Node_);
+		while(true)
+		{
+			bitmapWords_ = (capacity_ + 63) / 64;
+			headerBytes_ = sizeof(BlockHeader_) + bitmapWords_ * sizeof(uint64);
+			headerBytes_ = (headerBytes_ + nodeAlignment - 1) & ~(nodeAlignment - 1);
+			if(headerBytes_ + capacity_ * sizeof(Node_) <= blockSpan_)
+			{
+				break;
+			}
+			--capacity_;
+		}
+	}
+	newBlock(capacity_);
 }
 
 template<typename T,
 		 class AllocationPolicy,
-		 bool aligned>
-BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::BasicMemoryPoolAllocationPolicy(const BasicMemoryPoolAllocationPolicy& other) 
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::BasicMemoryPoolAllocationPolicy(const BasicMemoryPoolAllocationPolicy& other) 
 : capacity_(other.capacity_),
-  freeNode_(other.freeNode_),
-  currentNode_(other.currentNode_),
+  freeNode_(nullptr),
+  currentNode_(nullptr),
   currentBlock_(other.currentBlock_),
-  firstNode_()
+  firstNode_(),
+  blockMemory_(),
+  bumpNode_(nullptr),
+  bumpEnd_(nullptr),
+  bitmapWords_(other.bitmapWords_),
+  headerBytes_(other.headerBytes_),
+  blockSpan_(other.blockSpan_),
+  blockBytes_(other.blockBytes_),
+  mappedBase_(nullptr),
+  mappedBytes_(0),
+  releaseMapping_(nullptr),
+  readOnly_(false)
 {
-	for(auto e : other.firstNode_)
+	// Same blocks, each node of other has its twin at the same place in ours
+	for(uint64 b = 0; b < other.firstNode_.size(); ++b)
 	{
-		newBlock(capacity_);
-		std::copy(*other.firstNode_.begin(), *other.firstNode_.begin() + capacity_, currentNode_);
+		firstNode_.push_back(reserveBlock(capacity_ * sizeof(Node_), aligned ? alignement : 1));
 	}
+	currentNode_ = firstNode_.empty() ? nullptr : firstNode_.back();
+	
+	SortedBlocks_ sortedBlocks = other.sortBlocks();
+	auto twinOf = [&](const Node_* node)
+	{
+		uint64 b = blockIndexOf(sortedBlocks, node);
+		return firstNode_[b] + (node - other.firstNode_[b]);
+	};
+	
+	// Free list in the same order, then the live objects are copied over
+	Node_** link = &freeNode_;
+	for(const Node_* node = other.freeNode_; node != nullptr; node = node->next_)
+	{
+		*link = twinOf(node);
+		link = &(*link)->next_;
+	}
+	*link = nullptr;
+	
+	if(other.bumpNode_ != nullptr)
+	{
+		bumpNode_ = firstNode_[currentBlock_] + (other.bumpNode_ - other.firstNode_[currentBlock_]);
+		bumpEnd_ = firstNode_[currentBlock_] + capacity_;
+	}
+	
+	// forEachLive doesn't change the pool, it is just not const because f may change the objects
+	const_cast<BasicMemoryPoolAllocationPolicy&>(other).forEachLive([&](T& object)
+	{
+		Node_* node = twinOf(reinterpret_cast<const Node_*>(&object));
+		new(node) T(object);
+		markLive(node);
+	});
 }
 
 template<typename T,
 		 class AllocationPolicy,
-		 bool aligned>
-BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::BasicMemoryPoolAllocationPolicy(BasicMemoryPoolAllocationPolicy&& other) 
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::BasicMemoryPoolAllocationPolicy(BasicMemoryPoolAllocationPolicy&& other) 
 : capacity_(other.capacity_),
   freeNode_(other.freeNode_),
   currentNode_(other.currentNode_),
   currentBlock_(other.currentBlock_),
-  firstNode_(other.firstNode_)
+  firstNode_(other.firstNode_),
+  blockMemory_(other.blockMemory_),
+  bumpNode_(other.bumpNode_),
+  bumpEnd_(other.bumpEnd_),
+  bitmapWords_(other.bitmapWords_),
+  headerBytes_(other.headerBytes_),
+  blockSpan_(other.blockSpan_),
+  blockBytes_(other.blockBytes_),
+  mappedBase_(other.mappedBase_),
+  mappedBytes_(other.mappedBytes_),
+  releaseMapping_(other.releaseMapping_),
+  readOnly_(other.readOnly_)
 {
 	other.firstNode_.clear();
+	other.blockMemory_.clear();
+	other.mappedBase_ = nullptr;
+	other.mappedBytes_ = 0;
+	other.readOnly_ = false;
 	other.freeNode_ = nullptr;
 	other.currentNode_ = nullptr;
-	other.currentBlock_ = 0;
+	other.currentBlock_ = -1;
+	other.bumpNode_ = nullptr;
+	other.bumpEnd_ = nullptr;
 }
 
 
 template<typename T,
 		 class AllocationPolicy,
-		 bool aligned>
-BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::~BasicMemoryPoolAllocationPolicy()
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::~BasicMemoryPoolAllocationPolicy()
 {
-	for(auto e : firstNode_)
+	// Objects still alive go with the pool (trivially copyable ones, the only ones a snapshot can hold, have nothing to destroy)
+	if(!std::is_trivially_destructible<T>::value)
 	{
-		operator delete(reinterpret_cast<T*>(e));
+		forEachLive([](T& object)
+		{
+			object.~T();
+		});
 	}
+	releaseBlocks();
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+void BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::releaseBlocks()
+{
+	for(auto e : blockMemory_)
+	{
+		if(!isMapped(e))
+		{
+			deallocateBlockMemory(e, AlignedBlocks_());
+		}
+	}
+	if(mappedBase_ != nullptr)
+	{
+		releaseMapping_(mappedBase_, mappedBytes_);
+	}
+	blockMemory_.clear();
+	firstNode_.clear();
+	mappedBase_ = nullptr;
+	mappedBytes_ = 0;
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+inline bool BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::isMapped(const void* memory) const
+{
+	return memory >= mappedBase_ && memory < mappedBase_ + mappedBytes_;
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+typename BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::SortedBlocks_
+BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::sortBlocks() const
+{
+	SortedBlocks_ sortedBlocks;
+	sortedBlocks.reserve(firstNode_.size());
+	for(uint64 b = 0; b < firstNode_.size(); ++b)
+	{
+		sortedBlocks.emplace_back(firstNode_[b], b);
+	}
+	std::sort(sortedBlocks.begin(), sortedBlocks.end());
+	return sortedBlocks;
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+inline uint64 BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::blockIndexOf(const SortedBlocks_& sortedBlocks, const Node_* node) const
+{
+	auto it = std::upper_bound(sortedBlocks.begin(), sortedBlocks.end(), std::make_pair(node, uint64(sortedBlocks.size())));
+	return (--it)->second;
 }
 
 
 template<typename T,
 		 class AllocationPolicy,
-		 bool aligned>
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
 template<bool isAligned>
-typename std::enable_if<!isAligned, typename BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::Node_>::type*
-BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::newBlock(allocation_size_type size)
+typename std::enable_if<!isAligned, typename BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::Node_>::type*
+BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::newBlock(allocation_size_type size)
 {
-	currentNode_ = static_cast<Node_*>(operator new(size * sizeof(Node_) + sizeof(Node_)));
+	currentNode_ = reserveBlock(size * sizeof(Node_), 1);
 	
 	firstNode_.push_back(currentNode_);
-	buildFreeList();
+	if(!lazyInit)
+	{
+		buildFreeList();
+	}
 	
 	return currentNode_;
 }
 
 template<typename T,
 		 class AllocationPolicy,
-		 bool aligned>
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
 template<bool isAligned>
-typename std::enable_if<isAligned, typename BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::Node_>::type*
-BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::newBlock(allocation_size_type size)
+typename std::enable_if<isAligned, typename BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::Node_>::type*
+BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::newBlock(allocation_size_type size)
 {
-	currentNode_ = static_cast<Node_*>(operator new(size * sizeof(Node_) + sizeof(Node_)*2));
-
-	currentNode_ += (-reinterpret_cast<uintptr_t>(currentNode_)) & (alignement - 1);
+	currentNode_ = reserveBlock(size * sizeof(Node_), alignement);
 	
 	firstNode_.push_back(currentNode_);
-	buildFreeList();
+	if(!lazyInit)
+	{
+		buildFreeList();
+	}
 	
 	return currentNode_;
 }
 
 template<typename T,
 		 class AllocationPolicy,
-		 bool aligned>
-void BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::buildFreeList()	
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+void BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::buildFreeList()	
 {
 	Node_* currentNode = currentNode_;
 	Node_* tmp = freeNode_;
@@ -204,54 +489,560 @@ void BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::buildFreeLis
 		freeNode_ = currentNode;
 		freeNode_->next_ = ++currentNode;
 	}
-	freeNode_->next_ = nullptr;
-	freeNode_ = tmp != nullptr ? tmp : currentNode_;
+	currentNode->next_ = tmp;
+	freeNode_ = currentNode_;
+}
+
+// Get the memory of a new block, with the occupancy header in front of the nodes if needed
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+typename BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::Node_*
+BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::reserveBlock(allocation_size_type nodeBytes, uint64 alignment)
+{
+	const uint64 blockAlignment = trackOccupancy ? blockSpan_ : alignment;
+	const uint64 padding = blockAlignment > BlockAlignmentOf<BlockAllocator>::value && !AlignedBlocks_::value ? blockAlignment - 1 : 0;
+	blockBytes_ = (trackOccupancy ? blockSpan_ : nodeBytes) + padding;
+	
+	char* memory = allocateBlockMemory(blockAlignment, AlignedBlocks_());
+	blockMemory_.push_back(memory);
+	memory += (-reinterpret_cast<uintptr_t>(memory)) & (blockAlignment - 1);
+	
+	if(trackOccupancy)
+	{
+		BlockHeader_* header = new(memory) BlockHeader_{0};
+		std::fill(bitsOf(header), bitsOf(header) + bitmapWords_, 0);
+		memory += headerBytes_;
+	}
+	return reinterpret_cast<Node_*>(memory);
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+char* BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::allocateBlockMemory(uint64 alignment, std::true_type)
+{
+	return BlockAllocator::allocateAligned(blockBytes_, alignment);
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+char* BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::allocateBlockMemory(uint64 alignment, std::false_type)
+{
+	return BlockAllocator::allocate(blockBytes_);
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+void BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::deallocateBlockMemory(void* memory, std::true_type)
+{
+	BlockAllocator::deallocateAligned(static_cast<char*>(memory), blockBytes_);
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+void BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::deallocateBlockMemory(void* memory, std::false_type)
+{
+	BlockAllocator::deallocate(static_cast<char*>(memory), blockBytes_);
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+inline typename BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::BlockHeader_*
+BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::headerOf(const void* node) const
+{
+	return reinterpret_cast<BlockHeader_*>(reinterpret_cast<uintptr_t>(node) & ~(blockSpan_ - 1));
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+inline uint64* BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::bitsOf(BlockHeader_* header) const
+{
+	return reinterpret_cast<uint64*>(header + 1);
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+inline allocation_size_type BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::indexOf(const void* node, const BlockHeader_* header) const
+{
+	return (reinterpret_cast<uintptr_t>(node) - reinterpret_cast<uintptr_t>(header) - headerBytes_) / sizeof(Node_);
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+inline void BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::markLive(const void* node)
+{
+	if(trackOccupancy)
+	{
+		BlockHeader_* header = headerOf(node);
+		allocation_size_type index = indexOf(node, header);
+		bitsOf(header)[index / 64] |= uint64(1) << (index % 64);
+		++header->live_;
+	}
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+inline void BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::markFree(const void* node)
+{
+	if(trackOccupancy)
+	{
+		BlockHeader_* header = headerOf(node);
+		allocation_size_type index = indexOf(node, header);
+		assert((bitsOf(header)[index / 64] >> (index % 64)) & 1); // Double free
+		bitsOf(header)[index / 64] &= ~(uint64(1) << (index % 64));
+		--header->live_;
+	}
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+bool BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::isLive(const T* ptr) const
+{
+	static_assert(trackOccupancy, "isLive needs the occupancy bitmaps, see trackOccupancy");
+	
+	BlockHeader_* header = headerOf(ptr);
+	allocation_size_type index = indexOf(ptr, header);
+	return (bitsOf(header)[index / 64] >> (index % 64)) & 1;
+}
+
+// A block can go when all the nodes it ever handed out are back in the free list (untouched blocks included).
+// Their nodes are first unlinked from the free list, then the block itself is released
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+allocation_size_type BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::trim()
+{
+	// A read only pool can't change, its pages are not even writable
+	if(readOnly_)
+	{
+		return 0;
+	}
+	
+	const uint64 blockCount = firstNode_.size();
+	std::vector<allocation_size_type> freeCount(blockCount, 0);
+	
+	if(trackOccupancy)
+	{
+		bool anyEmpty = false;
+		for(Node_* block : firstNode_)
+		{
+			anyEmpty = anyEmpty || headerOf(block)->live_ == 0;
+		}
+		if(!anyEmpty)
+		{
+			return 0;
+		}
+	}
+	
+	SortedBlocks_ sortedBlocks = sortBlocks();
+	auto blockOf = [&](const Node_* node)
+	{
+		return blockIndexOf(sortedBlocks, node);
+	};
+	
+	for(const Node_* node = freeNode_; node != nullptr; node = node->next_)
+	{
+		++freeCount[blockOf(node)];
+	}
+	
+	std::vector<bool> released(blockCount, false);
+	allocation_size_type releasedCount = 0;
+	for(uint64 b = 0; b < blockCount; ++b)
+	{
+		allocation_size_type used = capacity_;
+		if(lazyInit && static_cast<int64>(b) >= currentBlock_)
+		{
+			used = static_cast<int64>(b) == currentBlock_ ? bumpNode_ - firstNode_[b] : 0;
+		}
+		released[b] = freeCount[b] == used;
+		releasedCount += released[b];
+	}
+	if(releasedCount == 0)
+	{
+		return 0;
+	}
+	
+	Node_** link = &freeNode_;
+	while(*link != nullptr)
+	{
+		if(released[blockOf(*link)])
+		{
+			*link = (*link)->next_;
+		}
+		else
+		{
+			link = &(*link)->next_;
+		}
+	}
+	
+	uint64 kept = 0;
+	int64 currentBlock = -1;
+	for(uint64 b = 0; b < blockCount; ++b)
+	{
+		if(released[b])
+		{
+			if(!isMapped(blockMemory_[b])) // Mapped ones only go with the whole mapping
+			{
+				deallocateBlockMemory(blockMemory_[b], AlignedBlocks_());
+			}
+			continue;
+		}
+		if(static_cast<int64>(b) <= currentBlock_)
+		{
+			currentBlock = kept;
+		}
+		firstNode_[kept] = firstNode_[b];
+		blockMemory_[kept] = blockMemory_[b];
+		++kept;
+	}
+	firstNode_.resize(kept);
+	blockMemory_.resize(kept);
+	
+	// The block of the bump pointer is gone : blocks before it are full, so it goes to the end of the last one kept
+	const bool bumpReleased = lazyInit && currentBlock_ >= 0 && released[currentBlock_];
+	currentBlock_ = currentBlock;
+	if(bumpReleased)
+	{
+		bumpNode_ = currentBlock_ >= 0 ? firstNode_[currentBlock_] + capacity_ : nullptr;
+		bumpEnd_ = bumpNode_;
+	}
+	currentNode_ = kept != 0 ? firstNode_.back() : nullptr;
+	
+	return releasedCount;
 }
+
+// With the bitmaps, empty blocks are skipped through their live_ count, and inside a block we jump
+// from one set bit to the other with count trailing zeros
 template<typename T,
 		 class AllocationPolicy,
-		 bool aligned>
-T* BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::allocate(allocation_size_type size, const T* hint)
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+template<typename Function>
+void BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::forEachLive(Function&& f)
 {
+	if(trackOccupancy)
+	{
+		for(Node_* block : firstNode_)
+		{
+			BlockHeader_* header = headerOf(block);
+			if(header->live_ == 0)
+			{
+				continue;
+			}
+			
+			uint64* bits = bitsOf(header);
+			for(uint64 w = 0; w < bitmapWords_; ++w)
+			{
+				uint64 word = bits[w];
+				while(word != 0)
+				{
+					f(*reinterpret_cast<T*>(block + w * 64 + __builtin_ctzll(word)));
+					word &= word - 1;
+				}
+			}
+		}
+		return;
+	}
+	
+	std::unordered_set<const Node_*> freeNodes;
+	for(const Node_* node = freeNode_; node != nullptr; node = node->next_)
+	{
+		freeNodes.insert(node);
+	}
+	
+	for(uint64 b = 0; b < firstNode_.size(); ++b)
+	{
+		Node_* end = firstNode_[b] + capacity_;
+		if(lazyInit && static_cast<int64>(b) >= currentBlock_)
+		{
+			if(static_cast<int64>(b) > currentBlock_)
+			{
+				break;
+			}
+			end = bumpNode_;
+		}
+		
+		for(Node_* node = firstNode_[b]; node != end; ++node)
+		{
+			if(freeNodes.find(node) == freeNodes.end())
+			{
+				f(*reinterpret_cast<T*>(node));
+			}
+		}
+	}
+}
+
+// Move the bump pointer to the next untouched block, creating one if needed
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+typename BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::Node_*
+BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::nextFreshBlock()
+{
+	if(static_cast<uint64>(currentBlock_ + 1) == firstNode_.size())
+	{
+		newBlock(capacity_);
+	}
+	++currentBlock_;
+	bumpNode_ = firstNode_[currentBlock_];
+	bumpEnd_ = bumpNode_ + capacity_;
+	
+	return bumpNode_;
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+uint64 BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::getFreeCount() const
+{
+	uint64 count = 0;
+	for(const Node_* node = freeNode_; node != nullptr; node = node->next_)
+	{
+		++count;
+	}
+	return count;
+}
+
+// True if ptr was never handed out by the bump pointer
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+bool BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::isFresh(const T* ptr) const
+{
+	if(!lazyInit)
+	{
+		return false;
+	}
+	
+	const Node_* node = reinterpret_cast<const Node_*>(ptr);
+	if(node >= bumpNode_ && node < bumpEnd_)
+	{
+		return true;
+	}
+	for(uint64 i = currentBlock_ + 1; i < firstNode_.size(); ++i)
+	{
+		if(node >= firstNode_[i] && node < firstNode_[i] + capacity_)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Nodes are handed out one at a time, two allocations are not guaranteed to be next to each other
+// (they may come from the free list), so size must be 1. Use allocateBatch for several objects
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+T* BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::allocate(allocation_size_type size, const T* hint)
+{
+	assert(size == 1);
+	assert(!readOnly_);
 	Node_* returnPtr = nullptr;
 	
+	if(lazyInit && freeNode_ == nullptr)
+	{
+		returnPtr = bumpNode_ != bumpEnd_ ? bumpNode_ : nextFreshBlock();
+		++bumpNode_;
+		markLive(returnPtr);
+		return reinterpret_cast<T*>(returnPtr);
+	}
+	
 	returnPtr = freeNode_ != nullptr ? freeNode_ : newBlock(capacity_);
 	freeNode_ = freeNode_->next_;
+	markLive(returnPtr);
 	return reinterpret_cast<T*>(returnPtr);
 }
 
 // Do not rely on this to initialize memory to 0 after "deletion".
 // After deletion, it will only update free nodes implicit list
+// One node at a time, like allocate, deallocateBatch is the bulk version
 template<typename T,
 		 class AllocationPolicy,
-		 bool aligned>
-void BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>::deallocate(T* ptr, allocation_size_type size)
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+void BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::deallocate(T* ptr, allocation_size_type size)
 {
+	assert(size == 1);
 #	ifdef	DEBUG
 	bool t = false;
 	for(auto it = firstNode_.begin(); (it != firstNode_.end()) && !t; ++it)
 	{
-		t = ((reinterpret_cast<Node_*>(ptr) - *it + size - 1) <= capacity_);
+		t = ((reinterpret_cast<Node_*>(ptr) - *it) < capacity_);
 	}
 	assert(t == true); // need true assert here, with message
 #	endif
+	assert(!readOnly_);
 
-	Node_* tmp;
-	for(ptrdiff i = 0; i != size; ++i)
+	Node_* tmp = freeNode_;
+	freeNode_ = reinterpret_cast<Node_*>(ptr);
+	if(!std::is_trivially_destructible<T>::value)
 	{
-		tmp = freeNode_;
-		freeNode_ = reinterpret_cast<Node_*>(ptr);
 		(*reinterpret_cast<T*>(freeNode_)).~T();
-		freeNode_->next_= tmp;
 	}
+	markFree(freeNode_);
+	freeNode_->next_= tmp;
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+void BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::allocateBatch(T** output, allocation_size_type count)
+{
+	assert(!readOnly_);
+	allocation_size_type i = 0;
+	while(i < count)
+	{
+		for(; i < count && freeNode_ != nullptr; ++i)
+		{
+			output[i] = reinterpret_cast<T*>(freeNode_);
+			markLive(freeNode_);
+			freeNode_ = freeNode_->next_;
+		}
+		
+		if(i == count)
+		{
+			break;
+		}
+		
+		if(!lazyInit)
+		{
+			newBlock(capacity_);
+			continue;
+		}
+		
+		if(bumpNode_ == bumpEnd_)
+		{
+			nextFreshBlock();
+		}
+		allocation_size_type carved = bumpEnd_ - bumpNode_;
+		carved = carved < count - i ? carved : count - i;
+		for(allocation_size_type j = 0; j < carved; ++j)
+		{
+			output[i + j] = reinterpret_cast<T*>(bumpNode_ + j);
+			markLive(bumpNode_ + j);
+		}
+		bumpNode_ += carved;
+		i += carved;
+	}
+}
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+void BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::deallocateBatch(T* const* ptrs, allocation_size_type count)
+{
+	assert(!readOnly_);
+	if(count == 0)
+	{
+		return;
+	}
+	
+	for(allocation_size_type i = 0; i < count; ++i)
+	{
+		if(!std::is_trivially_destructible<T>::value)
+		{
+			ptrs[i]->~T();
+		}
+		markFree(ptrs[i]);
+	}
+	
+	for(allocation_size_type i = 0; i < count - 1; ++i)
+	{
+		reinterpret_cast<Node_*>(ptrs[i])->next_ = reinterpret_cast<Node_*>(ptrs[i + 1]);
+	}
+	reinterpret_cast<Node_*>(ptrs[count - 1])->next_ = freeNode_;
+	freeNode_ = reinterpret_cast<Node_*>(ptrs[0]);
 }
 
 
 // Alias for the memory pool allocator 
-// Todo : Switch to thread-safe version if requested
+// Not thread-safe, see ConcurrentMemoryPoolAllocator in ConcurrentMemoryPool.hxx for that
 template<typename T, 
 		 class AllocationPolicy = DefaultAllocationPolicy<T>,
-		 bool aligned = true>
-using BasicMemoryPoolAllocator = Allocator<T, BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned>>;
+		 bool aligned = true,
+		 bool lazyInit = true,
+		 bool trackOccupancy = false>
+using BasicMemoryPoolAllocator = Allocator<T, BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>>;
+
+// Gives the object back to the pool it comes from, pools call the destructor in deallocate.
+// Only a pointer to the pool is kept, so the pool must outlive the handles
+template<class Pool>
+class PoolDeleter
+{
+	public:
+	PoolDeleter(Pool* pool = nullptr) 
+	: pool_(pool)
+	{}
+	
+	template<typename T>
+	void operator()(T* ptr) const
+	{
+		pool_->deallocate(ptr, 1);
+	}
+	
+	Pool* getPool() const
+	{
+		return pool_;
+	}
+	
+	private:
+	Pool* pool_;
+};
+
+// Handle type of MemoryPool::makeUnique. Pool is the allocator of the MemoryPool, not the MemoryPool itself,
+// so that MemoryPool<T> gives PoolUniquePtr<T>
+template<typename T,
+		 class Pool = BasicMemoryPoolAllocator<T>>
+using PoolUniquePtr = std::unique_ptr<T, PoolDeleter<Pool>>;
 
 // Basically just adding a subset of std::vector functionalities
 template<typename T,
@@ -272,17 +1063,29 @@ class MemoryPool : public AllocationPolicy
 	{}
 	
 	explicit MemoryPool(MemoryPool&& other) 
-	: Allocator(other), 
+	: Allocator(std::move(other)), 
 	  size_(other.size_)
 	{
-		size_ = 0;
+		other.size_ = 0;
 	}
 	~MemoryPool() = default;
 	
 	template<typename U>
 	void add(U&& element);
+	// Construct the object right in its node
+	template<typename... Args>
+	T* emplace(Args&&... args);
+	// Same, but the object goes back to the pool when the handle dies.
+	// The shared version allocates its control block on the heap, as std::shared_ptr with a deleter always does
+	template<typename... Args>
+	PoolUniquePtr<T, Allocator> makeUnique(Args&&... args);
+	template<typename... Args>
+	std::shared_ptr<T> makeShared(Args&&... args);
+	template<typename ForwardIterator>
+	void addRange(ForwardIterator first, ForwardIterator last);
 	
 	void remove(T* elementPtr);
+	void removeRange(T* const* elementPtrs, allocation_size_type count);
 	void removeAt(allocation_size_type position);
 	void removeFirst();
 	void removeLast();
@@ -294,24 +1097,84 @@ class MemoryPool : public AllocationPolicy
 	
 	bool isDeleted(allocation_size_type position) const;
 	bool isDeleted(T* ptr) const;
+	
+	template<typename Function>
+	void forEach(Function&& f);
+	
+	// Trivially copyable T only, see PoolSnapshot.hxx. restore(path) maps the file copy on write
+	bool save(const char* path) const;
+	bool restore(const char* path);
+	bool restore(const char* path, SnapshotMode mode);
 
 	allocation_size_type getSize()
 	{
 		return size_;
 	}
 	
+	private:
+	bool isDeleted(T* ptr, std::true_type hasOccupancy) const;
+	bool isDeleted(T* ptr, std::false_type hasOccupancy) const;
+	
 	private:
 	size_t size_;
 };
 
-// Test if atomic or object and call the right method
+// Nodes are raw memory, so the element is constructed in place rather than assigned
 template<typename T,
 		 class AllocationPolicy>
 template<typename U>
 inline void MemoryPool<T, AllocationPolicy>::add(U&& element)
 {
-	*Allocator::allocate(1) = std::forward<T>(element);
+	emplace(std::forward<U>(element));
+}
+
+template<typename T,
+		 class AllocationPolicy>
+template<typename... Args>
+inline T* MemoryPool<T, AllocationPolicy>::emplace(Args&&... args)
+{
+	T* ptr = new(Allocator::allocate(1)) T(std::forward<Args>(args)...);
 	++size_;
+	return ptr;
+}
+
+template<typename T,
+		 class AllocationPolicy>
+template<typename... Args>
+inline PoolUniquePtr<T, typename MemoryPool<T, AllocationPolicy>::Allocator> MemoryPool<T, AllocationPolicy>::makeUnique(Args&&... args)
+{
+	return PoolUniquePtr<T, Allocator>(emplace(std::forward<Args>(args)...), PoolDeleter<Allocator>(this));
+}
+
+template<typename T,
+		 class AllocationPolicy>
+template<typename... Args>
+inline std::shared_ptr<T> MemoryPool<T, AllocationPolicy>::makeShared(Args&&... args)
+{
+	return std::shared_ptr<T>(emplace(std::forward<Args>(args)...), PoolDeleter<Allocator>(this));
+}
+
+// Nodes are fetched by chunks, so the pool is hit once every chunkSize elements
+template<typename T,
+		 class AllocationPolicy>
+template<typename ForwardIterator>
+void MemoryPool<T, AllocationPolicy>::addRange(ForwardIterator first, ForwardIterator last)
+{
+	constexpr allocation_size_type chunkSize = 64;
+	T* nodes[chunkSize];
+	
+	allocation_size_type remaining = std::distance(first, last);
+	while(remaining != 0)
+	{
+		allocation_size_type count = remaining < chunkSize ? remaining : chunkSize;
+		Allocator::allocateBatch(nodes, count);
+		for(allocation_size_type i = 0; i < count; ++i, ++first)
+		{
+			new(nodes[i]) T(*first);
+		}
+		size_ += count;
+		remaining -= count;
+	}
 }
 
 template<typename T,
@@ -321,6 +1184,13 @@ void MemoryPool<T, AllocationPolicy>::remove(T* elementPtr)
 	Allocator::deallocate(elementPtr, 1);
 }
 
+template<typename T,
+		 class AllocationPolicy>
+void MemoryPool<T, AllocationPolicy>::removeRange(T* const* elementPtrs, allocation_size_type count)
+{
+	Allocator::deallocateBatch(elementPtrs, count);
+}
+
 template<typename T,
 		 class AllocationPolicy>
 void MemoryPool<T, AllocationPolicy>::removeAt(allocation_size_type position)
@@ -347,8 +1217,8 @@ template<typename T,
 void MemoryPool<T, AllocationPolicy>::resize(allocation_size_type size)
 {
 	size_ = size;
-	uint64 offset = (size / Allocator::capacity_) - Allocator::firstNode_.size();
-	for(uint64 i = 0; i < offset; ++i)
+	uint64 blockCount = (size + Allocator::capacity_ - 1) / Allocator::capacity_;
+	while(Allocator::firstNode_.size() < blockCount)
 	{
 		Allocator::newBlock(Allocator::capacity_);
 	}
@@ -383,6 +1253,21 @@ bool MemoryPool<T, AllocationPolicy>::isDeleted(allocation_size_type position) c
 template<typename T,
 		 class AllocationPolicy>
 bool MemoryPool<T, AllocationPolicy>::isDeleted(T* ptr) const
+{
+	return isDeleted(ptr, std::integral_constant<bool, Allocator::hasOccupancy>());
+}
+
+template<typename T,
+		 class AllocationPolicy>
+bool MemoryPool<T, AllocationPolicy>::isDeleted(T* ptr, std::true_type) const
+{
+	return !Allocator::isLive(ptr);
+}
+
+// No bitmap, we have no choice but to walk the free list
+template<typename T,
+		 class AllocationPolicy>
+bool MemoryPool<T, AllocationPolicy>::isDeleted(T* ptr, std::false_type) const
 {
 	typedef typename Allocator::Node_ Node;
 	Node* tmp = Allocator::freeNode_;
@@ -394,8 +1279,15 @@ bool MemoryPool<T, AllocationPolicy>::isDeleted(T* ptr) const
 		}
 		tmp = tmp->next_;
 	}
-	return false;
+	return Allocator::isFresh(ptr);
 }
 
+template<typename T,
+		 class AllocationPolicy>
+template<typename Function>
+void MemoryPool<T, AllocationPolicy>::forEach(Function&& f)
+{
+	Allocator::forEachLive(std::forward<Function>(f));
+}
 
 #endif // MEMORYPOOL
@@ -0,0 +1,160 @@
+#ifndef PAGEALLOCATIONPOLICY
+#define PAGEALLOCATIONPOLICY
+
+/************************************************************************/
+// Internet Software Consortium (ISC) License 
+// Version 1, December 2015 
+// 
+// Copyright (C) 2015 Loic URIEN <urien.loic.cours@gmail.com> 
+// 
+// Permission to use, copy, modify, and/or distribute this software 
+// for any purpose with or without fee is hereby granted, 
+// provided that the above copyright notice and this permission notice 
+// appear in all copies unless the author says otherwise. 
+// 
+// THE SOFTWARE IS PROVIDED "AS IS" 
+// AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE 
+// INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. 
+// IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, 
+// DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER 
+// RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION 
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF 
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE. 
+/************************************************************************/
+
+#include <Allocator.hxx>
+#include <cassert>
+#include <sys/mman.h>
+
+// Map bytes (a multiple of the page size) aligned on alignment : map alignment more than needed,
+// then cut what sticks out on both sides of the aligned part
+inline char* mapAligned(uint64 bytes, uint64 alignment)
+{
+	char* ptr = static_cast<char*>(mmap(nullptr, bytes + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	assert(ptr != MAP_FAILED);
+	if(ptr == MAP_FAILED)
+	{
+		return nullptr;
+	}
+	
+	char* aligned = ptr + ((-reinterpret_cast<uintptr_t>(ptr)) & (alignment - 1));
+	if(aligned != ptr)
+	{
+		munmap(ptr, aligned - ptr);
+	}
+	if(aligned + bytes != ptr + bytes + alignment)
+	{
+		munmap(aligned + bytes, (ptr + alignment) - aligned);
+	}
+	return aligned;
+}
+
+// Allocation policies getting their memory straight from the OS, with anonymous mappings.
+// They are meant to be block sources for the pools (the AllocationPolicy of BasicMemoryPoolAllocationPolicy),
+// not to allocate small things : every call costs a system call and at least a page.
+// The point is that deallocate really gives the memory back (munmap), where operator delete usually keeps it around.
+// Like operator new[] in release builds (no exceptions there), failure is not recoverable, we only assert on it
+template<typename T>
+class MmapAllocationPolicy 
+    : public StlAllocationPolicy<T, MmapAllocationPolicy>
+{   
+	public:
+	using StlAllocationPolicy<T, ::MmapAllocationPolicy>::StlAllocationPolicy;	
+	
+	static constexpr uint64 blockAlignment = 4096; // Smallest page size we can meet
+	
+	T* allocate(allocation_size_type size, const T* hint = nullptr)
+	{
+		void* ptr = mmap(nullptr, size * sizeof(T), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		assert(ptr != MAP_FAILED);
+		return ptr != MAP_FAILED ? static_cast<T*>(ptr) : nullptr;
+	}
+	void deallocate(T* ptr, allocation_size_type size)
+	{
+		munmap(ptr, size * sizeof(T));
+	}
+	T* allocateAligned(allocation_size_type size, uint64 alignment)
+	{
+		const uint64 bytes = (size * sizeof(T) + blockAlignment - 1) & ~(blockAlignment - 1);
+		return reinterpret_cast<T*>(mapAligned(bytes, alignment > blockAlignment ? alignment : blockAlignment));
+	}
+	void deallocateAligned(T* ptr, allocation_size_type size)
+	{
+		munmap(ptr, size * sizeof(T));
+	}
+	void construct(T* ptr, const T& ref)
+	{
+		new(ptr) T(ref); 
+	}
+	void destroy(T* ptr)
+	{
+		ptr->~T();
+	}
+	
+	template<typename U>
+	bool equals(MmapAllocationPolicy<U>) const
+	{
+		return true;
+	}
+};
+
+// Same, but every allocation is rounded up to and aligned on 2 MB, and flagged for transparent huge pages.
+// A big pool then needs a TLB entry per 2 MB instead of per 4 KB. Only a hint : if the kernel has THP disabled,
+// or no huge page is available, we get regular pages (still 2 MB aligned)
+template<typename T>
+class HugePageAllocationPolicy 
+    : public StlAllocationPolicy<T, HugePageAllocationPolicy>
+{   
+	public:
+	using StlAllocationPolicy<T, ::HugePageAllocationPolicy>::StlAllocationPolicy;	
+	
+	static constexpr uint64 hugePageSize = 2 * 1024 * 1024;
+	static constexpr uint64 blockAlignment = hugePageSize;
+	
+	T* allocate(allocation_size_type size, const T* hint = nullptr)
+	{
+		return allocateAligned(size, hugePageSize);
+	}
+	void deallocate(T* ptr, allocation_size_type size)
+	{
+		munmap(ptr, roundUp(size * sizeof(T)));
+	}
+	T* allocateAligned(allocation_size_type size, uint64 alignment)
+	{
+		const uint64 bytes = roundUp(size * sizeof(T));
+		char* ptr = mapAligned(bytes, alignment > hugePageSize ? alignment : hugePageSize);
+#		ifdef MADV_HUGEPAGE
+		if(ptr != nullptr)
+		{
+			madvise(ptr, bytes, MADV_HUGEPAGE);
+		}
+#		endif
+		return reinterpret_cast<T*>(ptr);
+	}
+	void deallocateAligned(T* ptr, allocation_size_type size)
+	{
+		deallocate(ptr, size);
+	}
+	void construct(T* ptr, const T& ref)
+	{
+		new(ptr) T(ref); 
+	}
+	void destroy(T* ptr)
+	{
+		ptr->~T();
+	}
+	
+	template<typename U>
+	bool equals(HugePageAllocationPolicy<U>) const
+	{
+		return true;
+	}
+	
+	private:
+	static uint64 roundUp(uint64 bytes)
+	{
+		return (bytes + hugePageSize - 1) & ~(hugePageSize - 1);
+	}
+};
+
+#endif // PAGEALLOCATIONPOLICY
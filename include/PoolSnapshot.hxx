@@ -0,0 +1,363 @@
+#ifndef POOLSNAPSHOT
+#define POOLSNAPSHOT
+
+/************************************************************************/
+// Internet Software Consortium (ISC) License 
+// Version 1, December 2015 
+// 
+// Copyright (C) 2015 Loic URIEN <urien.loic.cours@gmail.com> 
+// 
+// Permission to use, copy, modify, and/or distribute this software 
+// for any purpose with or without fee is hereby granted, 
+// provided that the above copyright notice and this permission notice 
+// appear in all copies unless the author says otherwise. 
+// 
+// THE SOFTWARE IS PROVIDED "AS IS" 
+// AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE 
+// INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. 
+// IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, 
+// DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER 
+// RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION 
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF 
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE. 
+/************************************************************************/
+
+#include <MemoryPool.hxx>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Saving and restoring pools of trivially copyable objects (BasicMemoryPoolAllocationPolicy::saveSnapshot and
+// restoreSnapshot, MemoryPool::save and restore). POSIX only, which is why it is not part of MemoryPool.hxx.
+// The file holds a header, then the blocks one after the other, every pointer being replaced by an offset
+// from the first block (plus a preferred base address). Restoring maps all the blocks at once, the free list links
+// being patched back to pointers only when the preferred address is taken
+
+// How a saved pool is mapped back. Both are private mappings, the file itself is never modified
+enum class SnapshotMode
+{
+	readOnly, // The pool can be read, not modified
+	copyOnWrite // Pages get copied the first time they are written
+};
+
+// Native byte order. Links are offsets from the first block plus preferredBase, 0 standing for nullptr
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+struct BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::SnapshotHeader_
+{
+	char magic_[8];
+	uint64 version_;
+	uint64 flags_; // trackOccupancy, lazyInit, aligned
+	uint64 nodeBytes_;
+	uint64 capacity_;
+	uint64 headerBytes_;
+	uint64 blockStride_; // Bytes from a block to the next
+	uint64 blockCount_;
+	uint64 blocksOffset_; // Where the blocks start in the file, a multiple of the page size
+	uint64 preferredBase_; // Links are stored as the addresses they would have with the blocks mapped there
+	uint64 freeNode_;
+	int64 currentBlock_;
+	uint64 bumpNode_; // Index in the current block
+	uint64 elementCount_;
+};
+
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+inline uint64 BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::getSnapshotFlags() const
+{
+	return uint64(trackOccupancy) | uint64(lazyInit) << 1 | uint64(aligned) << 2;
+}
+
+// With the bitmaps, blocks keep their power of two span (and alignment), the header being part of the block
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+inline uint64 BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::getSnapshotStride() const
+{
+	return trackOccupancy ? blockSpan_ : capacity_ * sizeof(Node_);
+}
+
+// Blocks are written one by one, from a copy in which the free nodes links are relocated to preferredBase
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+bool BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::saveSnapshot(const char* path, uint64 elementCount) const
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Only pools of trivially copyable objects can be saved");
+	
+	const uint64 stride = getSnapshotStride();
+	const uint64 nodesOffset = trackOccupancy ? headerBytes_ : 0;
+	const uint64 pageSize = sysconf(_SC_PAGESIZE);
+	const uint64 bytes = firstNode_.size() * stride;
+	const uint64 alignment = blockSpan_ > pageSize ? blockSpan_ : pageSize;
+	
+	// A range free right now in this process is very likely to be free in the restarted one as well,
+	// links pointing there means no patching at all when restoring
+	uint64 preferredBase = 0;
+	if(bytes != 0)
+	{
+		char* reserved = static_cast<char*>(mmap(nullptr, bytes + alignment, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+		if(reserved != MAP_FAILED)
+		{
+			preferredBase = reinterpret_cast<uintptr_t>(reserved) + ((-reinterpret_cast<uintptr_t>(reserved)) & (alignment - 1));
+			munmap(reserved, bytes + alignment);
+		}
+	}
+	
+	SortedBlocks_ sortedBlocks = sortBlocks();
+	auto relocate = [&](const Node_* node)
+	{
+		if(node == nullptr)
+		{
+			return uint64(0);
+		}
+		uint64 b = blockIndexOf(sortedBlocks, node);
+		return preferredBase + b * stride + nodesOffset + (node - firstNode_[b]) * sizeof(Node_);
+	};
+	
+	SnapshotHeader_ header{};
+	std::memcpy(header.magic_, "MEMPOOL", sizeof(header.magic_));
+	header.version_ = 1;
+	header.flags_ = getSnapshotFlags();
+	header.nodeBytes_ = sizeof(Node_);
+	header.capacity_ = capacity_;
+	header.headerBytes_ = headerBytes_;
+	header.blockStride_ = stride;
+	header.blockCount_ = firstNode_.size();
+	header.blocksOffset_ = (sizeof(SnapshotHeader_) + pageSize - 1) / pageSize * pageSize;
+	header.preferredBase_ = preferredBase;
+	header.freeNode_ = relocate(freeNode_);
+	header.currentBlock_ = currentBlock_;
+	header.bumpNode_ = bumpNode_ != nullptr ? bumpNode_ - firstNode_[currentBlock_] : ~uint64(0);
+	header.elementCount_ = elementCount;
+	
+	// Sorted by node, so the links of a block come together
+	std::vector<std::pair<uint64, uint64>> links;
+	for(const Node_* node = freeNode_; node != nullptr; node = node->next_)
+	{
+		links.emplace_back(relocate(node) - preferredBase, relocate(node->next_));
+	}
+	std::sort(links.begin(), links.end());
+	
+	std::FILE* file = std::fopen(path, "wb");
+	if(file == nullptr)
+	{
+		return false;
+	}
+	
+	std::vector<char> buffer(header.blocksOffset_ > stride ? header.blocksOffset_ : stride, 0);
+	std::memcpy(buffer.data(), &header, sizeof(header));
+	bool written = std::fwrite(buffer.data(), 1, header.blocksOffset_, file) == header.blocksOffset_;
+	
+	auto link = links.begin();
+	for(uint64 b = 0; written && b < firstNode_.size(); ++b)
+	{
+		const char* block = reinterpret_cast<const char*>(firstNode_[b]) - nodesOffset;
+		std::memcpy(buffer.data(), block, nodesOffset + capacity_ * sizeof(Node_));
+		for(; link != links.end() && link->first < (b + 1) * stride; ++link)
+		{
+			std::memcpy(buffer.data() + link->first - b * stride, &link->second, sizeof(uint64));
+		}
+		written = std::fwrite(buffer.data(), 1, stride, file) == stride;
+	}
+	
+	return std::fclose(file) == 0 && written;
+}
+
+// The file is mapped in one go, at preferredBase if that range is free. Then nothing is written, the free list is
+// only walked to check it, other pages come from the page cache as they are touched. Otherwise the blocks land
+// at an address aligned like our blocks would be, and the free list links are patched, which copies the pages
+// holding free nodes
+template<typename T,
+		 class AllocationPolicy,
+		 bool aligned,
+		 bool lazyInit,
+		 bool trackOccupancy>
+bool BasicMemoryPoolAllocationPolicy<T, AllocationPolicy, aligned, lazyInit, trackOccupancy>::restoreSnapshot(const char* path, SnapshotMode mode, uint64* elementCount)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Only pools of trivially copyable objects can be restored");
+	
+	const uint64 stride = getSnapshotStride();
+	const uint64 nodesOffset = trackOccupancy ? headerBytes_ : 0;
+	const uint64 pageSize = sysconf(_SC_PAGESIZE);
+	
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+	{
+		return false;
+	}
+	
+	// Everything used later on as a count or an index is checked here, before the pool is touched
+	SnapshotHeader_ header;
+	struct stat status;
+	bool valid = pread(fd, &header, sizeof(header), 0) == sizeof(header) && fstat(fd, &status) == 0
+	          && std::memcmp(header.magic_, "MEMPOOL", sizeof(header.magic_)) == 0 && header.version_ == 1
+	          && header.flags_ == getSnapshotFlags() && header.nodeBytes_ == sizeof(Node_) && header.capacity_ == capacity_
+	          && header.headerBytes_ == headerBytes_ && header.blockStride_ == stride && header.blocksOffset_ % pageSize == 0
+	          && uint64(status.st_size) >= header.blocksOffset_
+	          && header.blockCount_ <= (uint64(status.st_size) - header.blocksOffset_) / stride // Can't overflow, unlike a product
+	          && header.currentBlock_ >= -1 && header.currentBlock_ < static_cast<int64>(header.blockCount_)
+	          && (header.currentBlock_ < 0 || header.bumpNode_ <= capacity_);
+	
+	const uint64 bytes = header.blockCount_ * stride;
+	const uint64 alignment = blockSpan_ > pageSize ? blockSpan_ : pageSize;
+	char* base = nullptr;
+	if(valid && bytes != 0 && header.preferredBase_ != 0 && header.preferredBase_ % alignment == 0)
+	{
+#		ifdef MAP_FIXED_NOREPLACE
+		const int preferredFlags = MAP_PRIVATE | MAP_FIXED_NOREPLACE;
+#		else
+		const int preferredFlags = MAP_PRIVATE; // Only a hint then
+#		endif
+		void* preferred = reinterpret_cast<void*>(header.preferredBase_);
+		void* mapped = mmap(preferred, bytes, PROT_READ | PROT_WRITE, preferredFlags, fd, header.blocksOffset_);
+		if(mapped == preferred)
+		{
+			base = static_cast<char*>(mapped);
+		}
+		else if(mapped != MAP_FAILED)
+		{
+			munmap(mapped, bytes);
+		}
+	}
+	if(valid && bytes != 0 && base == nullptr)
+	{
+		// Reserve enough to find an aligned address in there, map the file over it, then give back the rest
+		char* reserved = static_cast<char*>(mmap(nullptr, bytes + alignment, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+		valid = reserved != MAP_FAILED;
+		if(valid)
+		{
+			base = reserved + ((-reinterpret_cast<uintptr_t>(reserved)) & (alignment - 1));
+			valid = mmap(base, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, header.blocksOffset_) != MAP_FAILED;
+			if(base != reserved)
+			{
+				munmap(reserved, base - reserved);
+			}
+			munmap(base + bytes, reserved + bytes + alignment - (base + bytes));
+			if(!valid)
+			{
+				munmap(base, bytes);
+				base = nullptr;
+			}
+		}
+	}
+	close(fd);
+	
+	const uint64 preferredBase = header.preferredBase_;
+	auto isNode = [&](uint64 address)
+	{
+		uint64 offset = address - preferredBase;
+		return address == 0 || (offset < bytes && offset % stride >= nodesOffset && (offset % stride - nodesOffset) % sizeof(Node_) == 0);
+	};
+	auto nodeAt = [&](uint64 address)
+	{
+		return address != 0 ? reinterpret_cast<Node_*>(base + (address - preferredBase)) : nullptr;
+	};
+	
+	// Check every link, so a damaged file can't send us anywhere, and patch them when not at preferredBase.
+	// At preferredBase the pages holding free nodes are only read, not copied
+	Node_* freeNode = nullptr;
+	valid = valid && isNode(header.freeNode_);
+	if(valid)
+	{
+		const bool relocated = reinterpret_cast<uint64>(base) != preferredBase;
+		freeNode = nodeAt(header.freeNode_);
+		uint64 remaining = bytes / sizeof(Node_);
+		for(Node_* node = freeNode; valid && node != nullptr;)
+		{
+			uint64 address;
+			std::memcpy(&address, node, sizeof(address));
+			valid = isNode(address) && remaining-- != 0;
+			Node_* next = valid ? nodeAt(address) : nullptr;
+			if(relocated)
+			{
+				node->next_ = next;
+			}
+			node = next;
+		}
+	}
+	if(!valid)
+	{
+		if(base != nullptr)
+		{
+			munmap(base, bytes);
+		}
+		return false;
+	}
+	
+	releaseBlocks();
+	mappedBase_ = base;
+	mappedBytes_ = bytes;
+	releaseMapping_ = [](char* mapping, uint64 length)
+	{
+		munmap(mapping, length);
+	};
+	for(uint64 b = 0; b < header.blockCount_; ++b)
+	{
+		blockMemory_.push_back(base + b * stride);
+		firstNode_.push_back(reinterpret_cast<Node_*>(base + b * stride + nodesOffset));
+	}
+	freeNode_ = freeNode;
+	currentNode_ = firstNode_.empty() ? nullptr : firstNode_.back();
+	currentBlock_ = header.currentBlock_;
+	bumpNode_ = nullptr;
+	bumpEnd_ = nullptr;
+	if(currentBlock_ >= 0)
+	{
+		bumpNode_ = firstNode_[currentBlock_] + header.bumpNode_;
+		bumpEnd_ = firstNode_[currentBlock_] + capacity_;
+	}
+	
+	readOnly_ = mode == SnapshotMode::readOnly;
+	if(readOnly_ && bytes != 0)
+	{
+		mprotect(base, bytes, PROT_READ);
+	}
+	if(elementCount != nullptr)
+	{
+		*elementCount = header.elementCount_;
+	}
+	return true;
+}
+
+template<typename T,
+		 class AllocationPolicy>
+bool MemoryPool<T, AllocationPolicy>::save(const char* path) const
+{
+	return Allocator::saveSnapshot(path, size_);
+}
+
+template<typename T,
+		 class AllocationPolicy>
+bool MemoryPool<T, AllocationPolicy>::restore(const char* path, SnapshotMode mode)
+{
+	uint64 size = 0;
+	if(!Allocator::restoreSnapshot(path, mode, &size))
+	{
+		return false;
+	}
+	size_ = size;
+	return true;
+}
+
+template<typename T,
+		 class AllocationPolicy>
+inline bool MemoryPool<T, AllocationPolicy>::restore(const char* path)
+{
+	return restore(path, SnapshotMode::copyOnWrite);
+}
+
+#endif // POOLSNAPSHOT
@@ -0,0 +1,313 @@
+#ifndef SMALLOBJECTALLOCATOR
+#define SMALLOBJECTALLOCATOR
+
+/************************************************************************/
+// Internet Software Consortium (ISC) License 
+// Version 1, December 2015 
+// 
+// Copyright (C) 2015 Loic URIEN <urien.loic.cours@gmail.com> 
+// 
+// Permission to use, copy, modify, and/or distribute this software 
+// for any purpose with or without fee is hereby granted, 
+// provided that the above copyright notice and this permission notice 
+// appear in all copies unless the author says otherwise. 
+// 
+// THE SOFTWARE IS PROVIDED "AS IS" 
+// AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE 
+// INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. 
+// IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, 
+// DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER 
+// RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION 
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF 
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE. 
+/************************************************************************/
+
+#include <MemoryPool.hxx>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <utility>
+
+// Small object allocator : a set of pools, one per size class, and every request goes to the smallest class it fits in.
+// The classes are given at compile time, the lookup from a size to its class is a table built at compile time as well.
+// Bigger requests fall back to operator new, over-aligned ones (more than alignof(std::max_align_t), which is all
+// operator new promises) to mallocAligned, so they still get their alignment.
+// Not thread-safe, like the pools it is made of : a heap shared between threads goes behind a LockedHeap
+
+template<std::size_t... sizes>
+struct SizeClasses
+{};
+
+typedef SizeClasses<8, 16, 32, 48, 64, 96, 128, 192, 256, 384, 512> DefaultSizeClasses;
+
+template<class SizeClassList = DefaultSizeClasses,
+		 class AllocationPolicy = DefaultAllocationPolicy<char>>
+class SmallObjectHeap;
+
+template<std::size_t... sizes,
+		 class AllocationPolicy>
+class SmallObjectHeap<SizeClasses<sizes...>, AllocationPolicy>
+{
+	static constexpr std::size_t granularity = 8;
+	static constexpr std::size_t classCount = sizeof...(sizes);
+	
+	// What the pools of a class are made of. Alignment is the biggest power of two dividing size, 
+	// capped to what operator new gives anyway
+	template<std::size_t size>
+	struct SizeClassStorage_
+	{
+		alignas((size & -size) < alignof(std::max_align_t) ? (size & -size) : alignof(std::max_align_t)) unsigned char bytes_[size];
+	};
+	
+	template<std::size_t size>
+	using Pool_ = BasicMemoryPoolAllocationPolicy<SizeClassStorage_<size>, typename AllocationPolicy::template rebind<SizeClassStorage_<size>>::other>;
+	
+	typedef std::tuple<Pool_<sizes>...> Pools_;
+	
+	public:
+	static constexpr std::size_t maxSize = std::get<classCount - 1>(std::make_tuple(sizes...));
+	
+	// Each class gets blocks of about blockBytes
+	explicit SmallObjectHeap(allocation_size_type blockBytes = 64 * 1024);
+	SmallObjectHeap(const SmallObjectHeap& other) = delete;
+	SmallObjectHeap& operator=(const SmallObjectHeap& other) = delete;
+	~SmallObjectHeap() = default;
+	
+	void* allocate(std::size_t bytes, std::size_t alignment);
+	void deallocate(void* ptr, std::size_t bytes, std::size_t alignment);
+	
+	private:
+	struct ClassTable_
+	{
+		uint8 index_[maxSize / granularity + 1];
+	};
+	
+	static constexpr ClassTable_ buildClassTable();
+	static std::size_t classOf(std::size_t bytes, std::size_t alignment);
+	
+	template<std::size_t index>
+	static void* allocateFrom(Pools_& pools)
+	{
+		return std::get<index>(pools).allocate(1);
+	}
+	
+	template<std::size_t index>
+	static void deallocateFrom(Pools_& pools, void* ptr)
+	{
+		typedef typename std::tuple_element<index, Pools_>::type Pool;
+		std::get<index>(pools).deallocate(static_cast<decltype(std::declval<Pool&>().allocate(1))>(ptr), 1);
+	}
+	
+	// Runtime class index to the right tuple element, through a table of function pointers
+	template<class Indices>
+	struct Dispatch_;
+	
+	template<std::size_t... indices>
+	struct Dispatch_<std::index_sequence<indices...>>
+	{
+		static void* allocate(Pools_& pools, std::size_t index)
+		{
+			static constexpr void* (*table[])(Pools_&) = { &allocateFrom<indices>... };
+			return table[index](pools);
+		}
+		
+		static void deallocate(Pools_& pools, std::size_t index, void* ptr)
+		{
+			static constexpr void (*table[])(Pools_&, void*) = { &deallocateFrom<indices>... };
+			table[index](pools, ptr);
+		}
+	};
+	
+	typedef Dispatch_<std::make_index_sequence<classCount>> Dispatch;
+	
+	private:
+	Pools_ pools_;
+};
+
+template<std::size_t... sizes,
+		 class AllocationPolicy>
+SmallObjectHeap<SizeClasses<sizes...>, AllocationPolicy>::SmallObjectHeap(allocation_size_type blockBytes)
+: pools_((blockBytes / sizes > 0 ? blockBytes / sizes : 1)...)
+{}
+
+// index_[(bytes + granularity - 1) / granularity] is the smallest class holding bytes
+template<std::size_t... sizes,
+		 class AllocationPolicy>
+constexpr typename SmallObjectHeap<SizeClasses<sizes...>, AllocationPolicy>::ClassTable_ 
+SmallObjectHeap<SizeClasses<sizes...>, AllocationPolicy>::buildClassTable()
+{
+	const std::size_t classSizes[] = { sizes... };
+	ClassTable_ table{};
+	std::size_t index = 0;
+	for(std::size_t slot = 0; slot <= maxSize / granularity; ++slot)
+	{
+		while(classSizes[index] < slot * granularity)
+		{
+			++index;
+		}
+		table.index_[slot] = static_cast<uint8>(index);
+	}
+	return table;
+}
+
+// Returns classCount when the request has to go to operator new (or mallocAligned)
+template<std::size_t... sizes,
+		 class AllocationPolicy>
+inline std::size_t SmallObjectHeap<SizeClasses<sizes...>, AllocationPolicy>::classOf(std::size_t bytes, std::size_t alignment)
+{
+	static constexpr ClassTable_ table = buildClassTable();
+	static constexpr std::size_t alignments[] = { alignof(SizeClassStorage_<sizes>)... };
+	
+	bytes = (bytes + alignment - 1) & ~(alignment - 1);
+	if(bytes > maxSize)
+	{
+		return classCount;
+	}
+	
+	std::size_t index = table.index_[(bytes + granularity - 1) / granularity];
+	return alignment <= alignments[index] ? index : classCount;
+}
+
+template<std::size_t... sizes,
+		 class AllocationPolicy>
+void* SmallObjectHeap<SizeClasses<sizes...>, AllocationPolicy>::allocate(std::size_t bytes, std::size_t alignment)
+{
+	std::size_t index = classOf(bytes, alignment);
+	if(index != classCount)
+	{
+		return Dispatch::allocate(pools_, index);
+	}
+	if(alignment <= alignof(std::max_align_t))
+	{
+		return operator new(bytes);
+	}
+	return mallocAligned(bytes, alignment);
+}
+
+template<std::size_t... sizes,
+		 class AllocationPolicy>
+void SmallObjectHeap<SizeClasses<sizes...>, AllocationPolicy>::deallocate(void* ptr, std::size_t bytes, std::size_t alignment)
+{
+	std::size_t index = classOf(bytes, alignment);
+	if(index != classCount)
+	{
+		Dispatch::deallocate(pools_, index, ptr);
+	}
+	else if(alignment <= alignof(std::max_align_t))
+	{
+		operator delete(ptr);
+	}
+	else
+	{
+		freeAligned(ptr);
+	}
+}
+
+// A heap behind a mutex, so that any thread can use it. The default heap of SmallObjectAllocator is one of these,
+// as every default constructed allocator in the process shares it
+template<class Heap = SmallObjectHeap<>>
+class LockedHeap
+{
+	public:
+	template<typename... Args>
+	explicit LockedHeap(Args&&... args)
+	: heap_(std::forward<Args>(args)...)
+	{}
+	LockedHeap(const LockedHeap& other) = delete;
+	LockedHeap& operator=(const LockedHeap& other) = delete;
+	
+	void* allocate(std::size_t bytes, std::size_t alignment)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return heap_.allocate(bytes, alignment);
+	}
+	
+	void deallocate(void* ptr, std::size_t bytes, std::size_t alignment)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		heap_.deallocate(ptr, bytes, alignment);
+	}
+	
+	// Heap used by default constructed SmallObjectAllocator. Never destroyed, so that containers with
+	// static storage duration can still give their nodes back at exit
+	static LockedHeap& getDefault()
+	{
+		static LockedHeap* heap = new LockedHeap();
+		return *heap;
+	}
+	
+	private:
+	std::mutex mutex_;
+	Heap heap_;
+};
+
+// The standard allocator facade, to put the heap under std::map, std::list, std::unordered_map, ...
+// It only holds a pointer to its heap : copies and rebound copies share it, and compare equal as long as they do.
+// Default construction needs a Heap with a getDefault (LockedHeap), a plain SmallObjectHeap has to be given
+// explicitly, and then belongs to whoever owns it (one thread at a time)
+template<typename T,
+		 class Heap = LockedHeap<>>
+class SmallObjectAllocator
+{
+	public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+	typedef std::false_type is_always_equal;
+	
+	template<typename U>
+	struct rebind
+	{
+		typedef SmallObjectAllocator<U, Heap> other;
+	};
+	
+	public:
+	SmallObjectAllocator() noexcept
+	: heap_(&Heap::getDefault())
+	{}
+	
+	explicit SmallObjectAllocator(Heap& heap) noexcept
+	: heap_(&heap)
+	{}
+	
+	template<typename U>
+	SmallObjectAllocator(const SmallObjectAllocator<U, Heap>& other) noexcept
+	: heap_(other.heap_)
+	{}
+	
+	T* allocate(std::size_t size)
+	{
+		return static_cast<T*>(heap_->allocate(size * sizeof(T), alignof(T)));
+	}
+	
+	void deallocate(T* ptr, std::size_t size) noexcept
+	{
+		heap_->deallocate(ptr, size * sizeof(T), alignof(T));
+	}
+	
+	Heap& getHeap() const
+	{
+		return *heap_;
+	}
+	
+	template<typename U>
+	bool operator==(const SmallObjectAllocator<U, Heap>& other) const noexcept
+	{
+		return heap_ == other.heap_;
+	}
+	
+	template<typename U>
+	bool operator!=(const SmallObjectAllocator<U, Heap>& other) const noexcept
+	{
+		return heap_ != other.heap_;
+	}
+	
+	private:
+	template<typename U, class OtherHeap>
+	friend class SmallObjectAllocator;
+	
+	Heap* heap_;
+};
+
+#endif // SMALLOBJECTALLOCATOR
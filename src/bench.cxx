@@ -0,0 +1,1109 @@
+/************************************************************************/
+// Internet Software Consortium (ISC) License 
+// Version 1, December 2015 
+// 
+// Copyright (C) 2015 Loic URIEN <urien.loic.cours@gmail.com> 
+// 
+// Permission to use, copy, modify, and/or distribute this software 
+// for any purpose with or without fee is hereby granted, 
+// provided that the above copyright notice and this permission notice 
+// appear in all copies unless the author says otherwise. 
+// 
+// THE SOFTWARE IS PROVIDED "AS IS" 
+// AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE 
+// INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. 
+// IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, 
+// DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER 
+// RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION 
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF 
+// OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE. 
+/************************************************************************/
+
+#include <MemoryPool.hxx>
+#include <ConcurrentMemoryPool.hxx>
+#include <PageAllocationPolicy.hxx>
+#include <PoolSnapshot.hxx>
+#include <SmallObjectAllocator.hxx>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#	include <linux/perf_event.h>
+#	include <sys/ioctl.h>
+#	include <sys/syscall.h>
+#	include <unistd.h>
+#endif
+
+// Benchmark suite of the pools.
+// Every workload is run once to warm up, then repetitions times. Each repetition gives one ns/op sample,
+// and the samples are summed up with min, median, 90th and 99th percentiles, max and mean.
+// Along with the timings we record how much resident memory the workload added at its peak, and,
+// when the kernel lets us, hardware counters of the timed parts (cycles, instructions, cache misses per op).
+// Everything is printed, and written as CSV to the file given as first argument, for regression tracking.
+// Usage : MemoryPoolBench [output.csv] [repetitions]
+
+#ifndef BENCH_OPT_LEVEL
+#	define BENCH_OPT_LEVEL "unknown"
+#endif
+
+static unsigned long x=123456789, y=362436069, z=521288629;
+// Shamelessly taken from a random stackoverflow article
+unsigned long randim(void)
+{
+	unsigned long t;
+	x ^= x << 16;
+	x ^= x >> 5;
+	x ^= x << 1;
+
+	t = x;
+	x = y;
+	y = z;
+	z = t ^ x ^ y;
+
+	return z;
+}
+
+// Resident set size in bytes, read from /proc (so Linux only, 0 elsewhere)
+uint64 residentMemory()
+{
+#	ifdef __linux__
+	static const uint64 pageSize = sysconf(_SC_PAGESIZE);
+	std::ifstream statm("/proc/self/statm");
+	uint64 pages = 0, resident = 0;
+	statm >> pages >> resident;
+	return resident * pageSize;
+#	else
+	return 0;
+#	endif
+}
+
+// Hardware counters of the calling thread through perf_event_open.
+// Quietly unavailable when not on Linux, or when perf_event_paranoid forbids it
+class PerfCounters
+{
+	public:
+	enum Counter
+	{
+		cycles,
+		instructions,
+		cacheMisses,
+		counterCount
+	};
+
+	PerfCounters()
+	{
+		std::fill(fds_, fds_ + counterCount, -1);
+		std::fill(values_, values_ + counterCount, 0);
+#		ifdef __linux__
+		const uint64 configs[counterCount] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES };
+		for(int i = 0; i < counterCount; ++i)
+		{
+			perf_event_attr attributes{};
+			attributes.type = PERF_TYPE_HARDWARE;
+			attributes.size = sizeof(attributes);
+			attributes.config = configs[i];
+			attributes.disabled = 1;
+			attributes.exclude_kernel = 1;
+			attributes.exclude_hv = 1;
+			fds_[i] = static_cast<int>(syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0));
+		}
+#		endif
+	}
+
+	~PerfCounters()
+	{
+#		ifdef __linux__
+		for(int fd : fds_)
+		{
+			if(fd >= 0)
+			{
+				close(fd);
+			}
+		}
+#		endif
+	}
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	bool isAvailable(Counter counter) const
+	{
+		return fds_[counter] >= 0;
+	}
+
+	void start()
+	{
+#		ifdef __linux__
+		for(int fd : fds_)
+		{
+			if(fd >= 0)
+			{
+				ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+				ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+#		endif
+	}
+
+	void stop()
+	{
+#		ifdef __linux__
+		for(int i = 0; i < counterCount; ++i)
+		{
+			values_[i] = 0;
+			if(fds_[i] >= 0)
+			{
+				ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+				if(read(fds_[i], &values_[i], sizeof(values_[i])) != sizeof(values_[i]))
+				{
+					values_[i] = 0;
+				}
+			}
+		}
+#		endif
+	}
+
+	uint64 get(Counter counter) const
+	{
+		return values_[counter];
+	}
+
+	private:
+	int fds_[counterCount];
+	uint64 values_[counterCount];
+};
+
+// Handed to every workload, which brackets what has to be timed with start and stop (several times if needed),
+// and calls sampleMemory, outside of the timed parts, where its memory usage peaks
+class Probe
+{
+	public:
+	explicit Probe(PerfCounters* counters)
+	: counters_(counters),
+	  elapsed_(0),
+	  rssBase_(residentMemory()),
+	  rssPeak_(0)
+	{
+		std::fill(totals_, totals_ + PerfCounters::counterCount, 0);
+	}
+
+	void start()
+	{
+		if(counters_ != nullptr)
+		{
+			counters_->start();
+		}
+		begin_ = std::chrono::steady_clock::now();
+	}
+
+	void stop()
+	{
+		auto end = std::chrono::steady_clock::now();
+		elapsed_ += std::chrono::duration<double, std::nano>(end - begin_).count();
+		if(counters_ != nullptr)
+		{
+			counters_->stop();
+			for(int i = 0; i < PerfCounters::counterCount; ++i)
+			{
+				totals_[i] += counters_->get(static_cast<PerfCounters::Counter>(i));
+			}
+		}
+	}
+
+	void sampleMemory()
+	{
+		uint64 rss = residentMemory();
+		rssPeak_ = std::max(rssPeak_, rss > rssBase_ ? rss - rssBase_ : 0);
+	}
+
+	double getElapsed() const
+	{
+		return elapsed_;
+	}
+
+	uint64 getPeakMemory() const
+	{
+		return rssPeak_;
+	}
+
+	uint64 getCounter(PerfCounters::Counter counter) const
+	{
+		return totals_[counter];
+	}
+
+	private:
+	PerfCounters* counters_;
+	std::chrono::steady_clock::time_point begin_;
+	double elapsed_;
+	uint64 rssBase_;
+	uint64 rssPeak_;
+	uint64 totals_[PerfCounters::counterCount];
+};
+
+struct Stats
+{
+	double min_;
+	double median_;
+	double p90_;
+	double p99_;
+	double max_;
+	double mean_;
+};
+
+// Nearest rank percentiles
+Stats computeStats(std::vector<double> samples)
+{
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&](double p)
+	{
+		size_t rank = static_cast<size_t>(std::ceil(p * samples.size()));
+		return samples[rank > 0 ? rank - 1 : 0];
+	};
+
+	double sum = 0;
+	for(double e : samples)
+	{
+		sum += e;
+	}
+	return Stats{samples.front(), percentile(0.5), percentile(0.9), percentile(0.99), samples.back(), sum / samples.size()};
+}
+
+struct Row
+{
+	std::string workload_;
+	std::string subject_;
+	uint64 valueBytes_;
+	uint64 capacity_;
+	uint64 parameter_; // Meaning depends on the workload : threads, batch size, sparsity...
+	uint64 operations_;
+	Stats stats_;
+	uint64 rssKiB_;
+	double counters_[PerfCounters::counterCount]; // Per operation, negative when not available
+};
+
+class Report
+{
+	public:
+	explicit Report(size_t repetitions)
+	: rows_(),
+	  repetitions_(repetitions),
+	  counters_()
+	{
+		std::cout << std::left << std::setw(18) << "workload" << std::setw(22) << "subject" << std::setw(8) << "bytes"
+		          << std::setw(10) << "capacity" << std::setw(10) << "param" << std::setw(12) << "median ns"
+		          << std::setw(12) << "p90 ns" << std::setw(10) << "RSS KiB" << std::endl;
+	}
+
+	template<class Workload>
+	void run(const char* workload, const char* subject, uint64 valueBytes, uint64 capacity, uint64 parameter,
+	         uint64 operations, Workload&& body, bool useCounters = true)
+	{
+		PerfCounters* counters = useCounters ? &counters_ : nullptr;
+		{
+			Probe warmUp(nullptr);
+			body(warmUp);
+		}
+
+		std::vector<double> samples;
+		uint64 rss = 0;
+		double totals[PerfCounters::counterCount] = {};
+		for(size_t r = 0; r < repetitions_; ++r)
+		{
+			Probe probe(counters);
+			body(probe);
+			samples.push_back(probe.getElapsed() / operations);
+			rss = std::max(rss, probe.getPeakMemory());
+			for(int i = 0; i < PerfCounters::counterCount; ++i)
+			{
+				totals[i] += probe.getCounter(static_cast<PerfCounters::Counter>(i));
+			}
+		}
+
+		Row row{workload, subject, valueBytes, capacity, parameter, operations, computeStats(samples), rss / 1024, {}};
+		for(int i = 0; i < PerfCounters::counterCount; ++i)
+		{
+			bool available = counters != nullptr && counters_.isAvailable(static_cast<PerfCounters::Counter>(i));
+			row.counters_[i] = available ? totals[i] / (double(operations) * repetitions_) : -1;
+		}
+		rows_.push_back(row);
+
+		std::cout << std::left << std::setw(18) << row.workload_ << std::setw(22) << row.subject_ << std::setw(8) << row.valueBytes_
+		          << std::setw(10) << row.capacity_ << std::setw(10) << row.parameter_ << std::setw(12) << row.stats_.median_
+		          << std::setw(12) << row.stats_.p90_ << std::setw(10) << row.rssKiB_ << std::endl;
+	}
+
+	bool write(const char* path) const
+	{
+		std::ofstream file(path);
+		if(!file)
+		{
+			return false;
+		}
+
+		file << "opt_level,compiler,workload,subject,value_bytes,capacity,parameter,operations,repetitions,"
+		     << "ns_per_op_min,ns_per_op_median,ns_per_op_p90,ns_per_op_p99,ns_per_op_max,ns_per_op_mean,"
+		     << "rss_kib,cycles_per_op,instructions_per_op,cache_misses_per_op\n";
+		for(const Row& row : rows_)
+		{
+			file << BENCH_OPT_LEVEL << ",\"" << __VERSION__ << "\"," << row.workload_ << "," << row.subject_ << ","
+			     << row.valueBytes_ << "," << row.capacity_ << "," << row.parameter_ << "," << row.operations_ << "," << repetitions_ << ","
+			     << row.stats_.min_ << "," << row.stats_.median_ << "," << row.stats_.p90_ << "," << row.stats_.p99_ << ","
+			     << row.stats_.max_ << "," << row.stats_.mean_ << "," << row.rssKiB_;
+			for(double counter : row.counters_)
+			{
+				file << ",";
+				if(counter >= 0)
+				{
+					file << counter;
+				}
+			}
+			file << "\n";
+		}
+		return static_cast<bool>(file);
+	}
+
+	private:
+	std::vector<Row> rows_;
+	size_t repetitions_;
+	PerfCounters counters_;
+};
+
+
+/************************************************************************/
+// Generic allocation workloads, run against every allocator
+/************************************************************************/
+
+struct SmallValue
+{
+	int32 value_;
+};
+
+struct LargeValue
+{
+	int64 value_;
+	char padding_[248];
+};
+
+// Same interface for everything we compare : allocate one object, deallocate one object
+template<typename T,
+         class Pool = BasicMemoryPoolAllocator<T>>
+class PoolSubject
+{
+	public:
+	typedef T value_type;
+	explicit PoolSubject(allocation_size_type capacity) : pool_(capacity){}
+	T* allocate(){ return pool_.allocate(1); }
+	void deallocate(T* ptr){ pool_.deallocate(ptr, 1); }
+	static const char* getName(){ return "MemoryPool"; }
+
+	private:
+	Pool pool_;
+};
+
+template<typename T>
+class NewSubject
+{
+	public:
+	typedef T value_type;
+	explicit NewSubject(allocation_size_type){}
+	T* allocate(){ return new T; }
+	void deallocate(T* ptr){ delete ptr; }
+	static const char* getName(){ return "new"; }
+};
+
+template<typename T>
+class MallocSubject
+{
+	public:
+	typedef T value_type;
+	explicit MallocSubject(allocation_size_type){}
+	T* allocate(){ return static_cast<T*>(std::malloc(sizeof(T))); }
+	void deallocate(T* ptr){ std::free(ptr); }
+	static const char* getName(){ return "malloc"; }
+};
+
+template<typename T>
+class StdAllocatorSubject
+{
+	public:
+	typedef T value_type;
+	explicit StdAllocatorSubject(allocation_size_type){}
+	T* allocate(){ return allocator_.allocate(1); }
+	void deallocate(T* ptr){ allocator_.deallocate(ptr, 1); }
+	static const char* getName(){ return "std::allocator"; }
+
+	private:
+	std::allocator<T> allocator_;
+};
+
+// Allocate count objects and keep them
+template<class Subject>
+void pureAllocate(Probe& probe, allocation_size_type capacity, size_t count)
+{
+	typedef typename Subject::value_type T;
+	std::vector<T*> ptrs(count);
+	Subject subject(capacity);
+
+	probe.start();
+	for(size_t i = 0; i < count; ++i)
+	{
+		ptrs[i] = subject.allocate();
+		ptrs[i]->value_ = i;
+	}
+	probe.stop();
+	probe.sampleMemory();
+
+	for(auto e : ptrs)
+	{
+		subject.deallocate(e);
+	}
+}
+
+// Keep live objects around, and replace a random one at each step, so lifetimes are random
+template<class Subject>
+void churn(Probe& probe, allocation_size_type capacity, size_t steps, size_t live)
+{
+	typedef typename Subject::value_type T;
+	std::vector<T*> ptrs(live);
+	std::vector<uint32> slots(steps);
+	for(auto& e : slots)
+	{
+		e = randim() % live;
+	}
+	Subject subject(capacity);
+	for(auto& e : ptrs)
+	{
+		e = subject.allocate();
+	}
+
+	probe.start();
+	for(size_t i = 0; i < steps; ++i)
+	{
+		T*& slot = ptrs[slots[i]];
+		subject.deallocate(slot);
+		slot = subject.allocate();
+		slot->value_ = i;
+	}
+	probe.stop();
+	probe.sampleMemory();
+
+	for(auto e : ptrs)
+	{
+		subject.deallocate(e);
+	}
+}
+
+// Allocate a wave of objects, then free it, last allocated first (lifo) or first allocated first (fifo)
+template<class Subject>
+void waves(Probe& probe, allocation_size_type capacity, size_t rounds, size_t wave, bool lifo)
+{
+	typedef typename Subject::value_type T;
+	std::vector<T*> ptrs(wave);
+	Subject subject(capacity);
+
+	probe.start();
+	for(size_t r = 0; r < rounds; ++r)
+	{
+		for(size_t i = 0; i < wave; ++i)
+		{
+			ptrs[i] = subject.allocate();
+			ptrs[i]->value_ = i;
+		}
+		if(lifo)
+		{
+			for(size_t i = wave; i != 0; --i)
+			{
+				subject.deallocate(ptrs[i - 1]);
+			}
+		}
+		else
+		{
+			for(size_t i = 0; i < wave; ++i)
+			{
+				subject.deallocate(ptrs[i]);
+			}
+		}
+	}
+	probe.stop();
+}
+
+template<class Subject>
+void runAllocatorWorkloads(Report& report, allocation_size_type capacity)
+{
+	typedef typename Subject::value_type T;
+	const size_t count = (64 << 20) / std::max<size_t>(sizeof(T), 64);
+	const size_t live = 1 << 14;
+	const size_t wave = 1 << 12;
+	const size_t rounds = count / wave;
+	const char* name = Subject::getName();
+
+	report.run("pure_allocate", name, sizeof(T), capacity, 0, count,
+	           [&](Probe& probe){ pureAllocate<Subject>(probe, capacity, count); });
+	report.run("churn_random", name, sizeof(T), capacity, live, 2 * count,
+	           [&](Probe& probe){ churn<Subject>(probe, capacity, count, live); });
+	report.run("lifo", name, sizeof(T), capacity, wave, 2 * rounds * wave,
+	           [&](Probe& probe){ waves<Subject>(probe, capacity, rounds, wave, true); });
+	report.run("fifo", name, sizeof(T), capacity, wave, 2 * rounds * wave,
+	           [&](Probe& probe){ waves<Subject>(probe, capacity, rounds, wave, false); });
+}
+
+template<typename T>
+void runValueType(Report& report)
+{
+	const size_t count = (64 << 20) / std::max<size_t>(sizeof(T), 64);
+
+	for(allocation_size_type capacity : {64, 4096, 65536})
+	{
+		runAllocatorWorkloads<PoolSubject<T>>(report, capacity);
+	}
+	runAllocatorWorkloads<NewSubject<T>>(report, 0);
+	runAllocatorWorkloads<MallocSubject<T>>(report, 0);
+	runAllocatorWorkloads<StdAllocatorSubject<T>>(report, 0);
+
+	// Containers can only take part in the pure allocation
+	report.run("pure_allocate", "MemoryPool::add", sizeof(T), 4096, 0, count, [&](Probe& probe)
+	{
+		MemoryPool<T> pool(4096);
+		T value{};
+		probe.start();
+		for(size_t i = 0; i < count; ++i)
+		{
+			value.value_ = i;
+			pool.add(value);
+		}
+		probe.stop();
+		probe.sampleMemory();
+	});
+	report.run("pure_allocate", "MemoryPool::emplace", sizeof(T), 4096, 0, count, [&](Probe& probe)
+	{
+		MemoryPool<T> pool(4096);
+		probe.start();
+		for(size_t i = 0; i < count; ++i)
+		{
+			pool.emplace()->value_ = i;
+		}
+		probe.stop();
+		probe.sampleMemory();
+	});
+	report.run("pure_allocate", "std::vector", sizeof(T), 0, 0, count, [&](Probe& probe)
+	{
+		std::vector<T> vector;
+		T value{};
+		probe.start();
+		for(size_t i = 0; i < count; ++i)
+		{
+			value.value_ = i;
+			vector.push_back(value);
+		}
+		probe.stop();
+		probe.sampleMemory();
+	});
+}
+
+
+/************************************************************************/
+// Pool specific workloads
+/************************************************************************/
+
+// Construction and resize of a big pool, eager free list against bump pointer
+template<bool lazyInit>
+void runStartup(Report& report, const char* name, allocation_size_type capacity)
+{
+	typedef MemoryPool<int, BasicMemoryPoolAllocator<int, DefaultAllocationPolicy<int>, true, lazyInit>> Pool;
+
+	report.run("startup_resize", name, sizeof(int), capacity, 4, 1, [&](Probe& probe)
+	{
+		probe.start();
+		Pool pool(capacity);
+		pool.resize(capacity * 4);
+		probe.stop();
+		probe.sampleMemory();
+	});
+}
+
+// Same churn, once object by object, once by batches
+void runBatch(Report& report, allocation_size_type batchSize)
+{
+	const size_t count = 1 << 20;
+	const size_t rounds = 4;
+	std::vector<int*> ptrs(count);
+
+	report.run("bulk_churn", "per_object", sizeof(int), 1 << 16, batchSize, 2 * count * rounds, [&](Probe& probe)
+	{
+		BasicMemoryPoolAllocator<int> pool(1 << 16);
+		probe.start();
+		for(size_t r = 0; r < rounds; ++r)
+		{
+			for(auto& e : ptrs)
+			{
+				e = pool.allocate(1);
+			}
+			for(auto e : ptrs)
+			{
+				pool.deallocate(e, 1);
+			}
+		}
+		probe.stop();
+	});
+	report.run("bulk_churn", "batch", sizeof(int), 1 << 16, batchSize, 2 * count * rounds, [&](Probe& probe)
+	{
+		BasicMemoryPoolAllocator<int> pool(1 << 16);
+		probe.start();
+		for(size_t r = 0; r < rounds; ++r)
+		{
+			for(size_t i = 0; i < count; i += batchSize)
+			{
+				pool.allocateBatch(&ptrs[i], batchSize);
+			}
+			for(size_t i = 0; i < count; i += batchSize)
+			{
+				pool.deallocateBatch(&ptrs[i], batchSize);
+			}
+		}
+		probe.stop();
+	});
+}
+
+// Keep one object out of sparsity alive, then visit the live objects, and ask isDeleted on a few
+template<bool trackOccupancy>
+void runIteration(Report& report, const char* name, size_t sparsity)
+{
+	typedef MemoryPool<int, BasicMemoryPoolAllocator<int, DefaultAllocationPolicy<int>, true, true, trackOccupancy>> Pool;
+	const size_t count = 1 << 20;
+	const size_t lookups = 20;
+	std::vector<int*> ptrs(count);
+
+	auto fill = [&](Pool& pool)
+	{
+		for(size_t i = 0; i < count; ++i)
+		{
+			ptrs[i] = pool.allocate(1);
+			*ptrs[i] = static_cast<int>(i);
+		}
+		for(size_t i = 0; i < count; ++i)
+		{
+			if(i % sparsity != 0)
+			{
+				pool.remove(ptrs[i]);
+			}
+		}
+	};
+
+	report.run("for_each_live", name, sizeof(int), 1 << 16, sparsity, count, [&](Probe& probe)
+	{
+		Pool pool(1 << 16);
+		fill(pool);
+		volatile long long sum = 0;
+		probe.start();
+		pool.forEach([&](int& e){ sum += e; });
+		probe.stop();
+	});
+	report.run("is_deleted", name, sizeof(int), 1 << 16, sparsity, lookups, [&](Probe& probe)
+	{
+		Pool pool(1 << 16);
+		fill(pool);
+		volatile size_t deleted = 0;
+		probe.start();
+		for(size_t i = 0; i < lookups; ++i)
+		{
+			deleted += pool.isDeleted(ptrs[(i * 7919) % count]);
+		}
+		probe.stop();
+	});
+}
+
+// Visit a big pool in random order (TLB bound), then free most of it and trim
+template<class AllocationPolicy>
+void runBlockSource(Report& report, const char* name)
+{
+	typedef MemoryPool<int, BasicMemoryPoolAllocator<int, AllocationPolicy>> Pool;
+	const size_t count = 1 << 22;
+	std::vector<int*> ptrs(count);
+
+	report.run("random_read", name, sizeof(int), 1 << 18, 0, count, [&](Probe& probe)
+	{
+		Pool pool(1 << 18);
+		for(size_t i = 0; i < count; ++i)
+		{
+			ptrs[i] = pool.allocate(1);
+			*ptrs[i] = static_cast<int>(i);
+		}
+		probe.sampleMemory();
+
+		volatile long long sum = 0;
+		size_t index = 0;
+		probe.start();
+		for(size_t i = 0; i < count; ++i)
+		{
+			index = (index + 2654435761u) % count;
+			sum += *ptrs[index];
+		}
+		probe.stop();
+	});
+	report.run("trim", name, sizeof(int), 1 << 18, 8, 1, [&](Probe& probe)
+	{
+		Pool pool(1 << 18);
+		for(size_t i = 0; i < count; ++i)
+		{
+			ptrs[i] = pool.allocate(1);
+		}
+		for(size_t i = count / 8; i < count; ++i)
+		{
+			pool.remove(ptrs[i]);
+		}
+		probe.start();
+		pool.trim();
+		probe.stop();
+		probe.sampleMemory();
+	});
+}
+
+// Poor man's std::barrier, all we need is to keep the worker threads alive between phases
+class Barrier
+{
+	public:
+	explicit Barrier(size_t count) : count_(count), waiting_(0), generation_(0){}
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		size_t generation = generation_;
+		if(++waiting_ == count_)
+		{
+			waiting_ = 0;
+			++generation_;
+			condition_.notify_all();
+		}
+		else
+		{
+			condition_.wait(lock, [&]{ return generation != generation_; });
+		}
+	}
+
+	private:
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	size_t count_;
+	size_t waiting_;
+	size_t generation_;
+};
+
+// The single threaded pool behind a mutex, as a reference point for the concurrent one
+class LockedPool
+{
+	public:
+	int* allocate(allocation_size_type size)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return pool_.allocate(size);
+	}
+
+	void deallocate(int* ptr, allocation_size_type size)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pool_.deallocate(ptr, size);
+	}
+
+	private:
+	std::mutex mutex_;
+	BasicMemoryPoolAllocator<int> pool_;
+};
+
+// Every thread fills its own slots, then frees the slots of its neighbour,
+// so that all the deallocations are cross-thread ones
+template<class Pool>
+void concurrentChurn(Probe& probe, size_t threadCount, size_t perThread, size_t rounds)
+{
+	Pool pool;
+	std::vector<std::vector<int*>> slots(threadCount, std::vector<int*>(perThread));
+	Barrier barrier(threadCount + 1);
+	std::vector<std::thread> workers;
+
+	for(size_t t = 0; t < threadCount; ++t)
+	{
+		workers.emplace_back([&, t]
+		{
+			barrier.wait();
+			for(size_t r = 0; r < rounds; ++r)
+			{
+				for(auto& e : slots[t])
+				{
+					e = pool.allocate(1);
+					*e = static_cast<int>(t);
+				}
+				barrier.wait();
+				for(auto e : slots[(t + 1) % threadCount])
+				{
+					pool.deallocate(e, 1);
+				}
+				barrier.wait();
+			}
+		});
+	}
+
+	probe.start();
+	barrier.wait();
+	for(size_t r = 0; r < rounds; ++r)
+	{
+		barrier.wait();
+		barrier.wait();
+	}
+	probe.stop();
+	for(auto& e : workers)
+	{
+		e.join();
+	}
+}
+
+// Counters only follow the calling thread, which mostly waits here, so they are left out
+void runConcurrent(Report& report, size_t threadCount)
+{
+	const size_t perThread = 100000;
+	const size_t rounds = 4;
+	const uint64 operations = 2 * threadCount * perThread * rounds;
+
+	report.run("concurrent_churn", "ConcurrentMemoryPool", sizeof(int), 4096, threadCount, operations,
+	           [&](Probe& probe){ concurrentChurn<ConcurrentMemoryPoolAllocator<int>>(probe, threadCount, perThread, rounds); }, false);
+	report.run("concurrent_churn", "locked MemoryPool", sizeof(int), 4096, threadCount, operations,
+	           [&](Probe& probe){ concurrentChurn<LockedPool>(probe, threadCount, perThread, rounds); }, false);
+}
+
+// Node based containers churning, the allocator being the only difference
+template<template<class> class Alloc>
+void containerChurn(Probe& probe, size_t count, const Alloc<int>& allocator = Alloc<int>())
+{
+	typedef std::pair<const int, int> Pair;
+	std::map<int, int, std::less<int>, Alloc<Pair>> map{Alloc<Pair>(allocator)};
+	std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, Alloc<Pair>> hashMap{Alloc<Pair>(allocator)};
+	std::list<int, Alloc<int>> list{Alloc<int>(allocator)};
+	std::vector<int> keys(2 * count);
+	for(auto& e : keys)
+	{
+		e = static_cast<int>(randim() % (2 * count));
+	}
+
+	probe.start();
+	for(size_t i = 0; i < count; ++i)
+	{
+		map[keys[i]] = i;
+		hashMap[keys[i]] = i;
+		list.push_back(i);
+	}
+	probe.stop();
+	probe.sampleMemory();
+	probe.start();
+	for(size_t i = count; i < 2 * count; ++i)
+	{
+		map.erase(keys[i]);
+		hashMap.erase(keys[i]);
+		list.pop_front();
+	}
+	probe.stop();
+}
+
+template<typename T>
+using DefaultSmallObjectAllocator = SmallObjectAllocator<T>;
+template<typename T>
+using UnlockedSmallObjectAllocator = SmallObjectAllocator<T, SmallObjectHeap<>>;
+
+void runContainers(Report& report)
+{
+	const size_t count = 200000;
+	report.run("node_containers", "std::allocator", 0, 0, 0, 6 * count,
+	           [&](Probe& probe){ containerChurn<std::allocator>(probe, count); });
+	report.run("node_containers", "SmallObjectAllocator", 0, 0, 0, 6 * count,
+	           [&](Probe& probe){ containerChurn<DefaultSmallObjectAllocator>(probe, count); });
+	// Same with a heap of our own, without the lock of the shared default one
+	report.run("node_containers", "SmallObjectHeap", 0, 0, 0, 6 * count, [&](Probe& probe)
+	{
+		SmallObjectHeap<> heap;
+		containerChurn<UnlockedSmallObjectAllocator>(probe, count, UnlockedSmallObjectAllocator<int>(heap));
+	});
+}
+
+// Getting a big pool back at startup : adding everything again, against mapping a saved one.
+// One object out of 8 is removed first, so that there is a free list to patch
+void runWarmStart(Report& report, const std::string& path)
+{
+	typedef MemoryPool<LargeValue> Pool;
+	const size_t count = 1 << 18;
+	const allocation_size_type capacity = 1 << 14;
+	bool saved = false;
+	long long expected = 0;
+	{
+		Pool pool(capacity);
+		std::vector<LargeValue*> ptrs(count);
+		for(size_t i = 0; i < count; ++i)
+		{
+			ptrs[i] = pool.emplace();
+			ptrs[i]->value_ = i;
+		}
+		for(size_t i = 0; i < count; i += 8)
+		{
+			pool.remove(ptrs[i]);
+		}
+		pool.forEach([&](LargeValue& e){ expected += e.value_; });
+		saved = pool.save(path.c_str());
+	}
+	if(!saved)
+	{
+		std::cerr << "Could not write " << path << ", skipping warm start" << std::endl;
+		return;
+	}
+	
+	// A restore that failed would time an empty pool, so check the content once, then give up on any failure
+	for(SnapshotMode mode : {SnapshotMode::copyOnWrite, SnapshotMode::readOnly})
+	{
+		Pool pool(capacity);
+		long long sum = 0;
+		bool restored = pool.restore(path.c_str(), mode);
+		pool.forEach([&](LargeValue& e){ sum += e.value_; });
+		if(!restored || sum != expected)
+		{
+			std::cerr << "Could not restore " << path << ", skipping warm start" << std::endl;
+			std::remove(path.c_str());
+			return;
+		}
+	}
+	auto restore = [&](Pool& pool, SnapshotMode mode)
+	{
+		if(!pool.restore(path.c_str(), mode))
+		{
+			std::cerr << "Could not restore " << path << std::endl;
+			std::abort();
+		}
+	};
+
+	report.run("warm_start", "rebuild", sizeof(LargeValue), capacity, 0, count, [&](Probe& probe)
+	{
+		LargeValue value{};
+		probe.start();
+		Pool pool(capacity);
+		for(size_t i = 0; i < count; ++i)
+		{
+			value.value_ = i;
+			pool.add(value);
+		}
+		probe.stop();
+		probe.sampleMemory();
+	});
+	report.run("warm_start", "restore_copy_on_write", sizeof(LargeValue), capacity, 0, count, [&](Probe& probe)
+	{
+		probe.start();
+		Pool pool(capacity);
+		restore(pool, SnapshotMode::copyOnWrite);
+		probe.stop();
+		probe.sampleMemory();
+	});
+	report.run("warm_start", "restore_read_only", sizeof(LargeValue), capacity, 0, count, [&](Probe& probe)
+	{
+		probe.start();
+		Pool pool(capacity);
+		restore(pool, SnapshotMode::readOnly);
+		probe.stop();
+		probe.sampleMemory();
+	});
+	// Mapping is lazy, so the first pass over the restored objects pays the page faults
+	report.run("warm_scan", "restore_read_only", sizeof(LargeValue), capacity, 0, count, [&](Probe& probe)
+	{
+		volatile long long sum = 0;
+		probe.start();
+		Pool pool(capacity);
+		restore(pool, SnapshotMode::readOnly);
+		pool.forEach([&](LargeValue& e){ sum += e.value_; });
+		probe.stop();
+		probe.sampleMemory();
+	});
+	std::remove(path.c_str());
+}
+
+// The cost of the statistics : the bare pool policy, the Allocator around it without stats (must be the same,
+// that's the zero overhead promise), then with counters only, and with counters and sampled latencies
+typedef BasicMemoryPoolAllocationPolicy<SmallValue> BarePolicy;
+typedef Allocator<SmallValue, BarePolicy, NoStatsAllocatorPolicy> NoStatsPool;
+typedef Allocator<SmallValue, BarePolicy, StatsAllocatorPolicy<uint64, 0>> CountersPool;
+typedef Allocator<SmallValue, BarePolicy, StatsAllocatorPolicy<>> SampledPool;
+
+static_assert(MEMORY_DEBUG || sizeof(NoStatsPool) == sizeof(BarePolicy), "Disabled stats must not take any room");
+
+template<class Pool>
+void runStats(Report& report, const char* name)
+{
+	typedef PoolSubject<SmallValue, Pool> Subject;
+	const size_t count = 1 << 20;
+	const size_t live = 1 << 14;
+
+	report.run("stats_allocate", name, sizeof(SmallValue), 4096, 0, count,
+	           [&](Probe& probe){ pureAllocate<Subject>(probe, 4096, count); });
+	report.run("stats_churn", name, sizeof(SmallValue), 4096, live, 2 * count,
+	           [&](Probe& probe){ churn<Subject>(probe, 4096, count, live); });
+}
+
+void runStatsOverhead(Report& report)
+{
+	runStats<BarePolicy>(report, "bare_policy");
+	runStats<NoStatsPool>(report, "stats_off");
+	runStats<CountersPool>(report, "stats_counters");
+	runStats<SampledPool>(report, "stats_sampled");
+}
+
+
+int main(int argc, char* argv[])
+{
+	const char* output = argc > 1 ? argv[1] : "bench_results.csv";
+	const size_t repetitions = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 11;
+
+	std::cout << "MemoryPool benchmarks, " << BENCH_OPT_LEVEL << ", " << repetitions << " repetitions" << std::endl;
+	Report report(repetitions);
+
+	runValueType<SmallValue>(report);
+	runValueType<LargeValue>(report);
+
+	for(allocation_size_type capacity : {1 << 16, 1 << 20, 1 << 22})
+	{
+		runStartup<false>(report, "eager", capacity);
+		runStartup<true>(report, "lazy", capacity);
+	}
+	for(allocation_size_type batchSize : {16, 64, 256, 1024})
+	{
+		runBatch(report, batchSize);
+	}
+	for(size_t sparsity : {1, 16, 1024})
+	{
+		runIteration<false>(report, "free_list", sparsity);
+		runIteration<true>(report, "bitmap", sparsity);
+	}
+	runBlockSource<DefaultAllocationPolicy<int>>(report, "new");
+	runBlockSource<MmapAllocationPolicy<int>>(report, "mmap");
+	runBlockSource<HugePageAllocationPolicy<int>>(report, "huge_page");
+
+	const size_t maxThreads = std::max<size_t>(std::thread::hardware_concurrency(), 4);
+	for(size_t threads = 1; threads <= maxThreads; ++threads)
+	{
+		runConcurrent(report, threads);
+	}
+	runContainers(report);
+	runStatsOverhead(report);
+	runWarmStart(report, std::string(output) + ".pool");
+
+	if(!report.write(output))
+	{
+		std::cerr << "Could not write " << output << std::endl;
+		return 1;
+	}
+	std::cout << "Results written to " << output << std::endl;
+	return 0;
+}
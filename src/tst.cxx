@@ -21,10 +21,12 @@
 
 
 #include <MemoryPool.hxx>
+#include <PoolSnapshot.hxx>
 #include <chrono>
+#include <cstdio>
 #include <iostream>
 
-// Some sample and performance measurement of the MemoryPool
+// Some sample of the MemoryPool, performance measurements live in bench.cxx
 MemoryPool<int> testPool;
 
 static unsigned long x=123456789, y=362436069, z=521288629;
@@ -44,6 +46,50 @@ unsigned long randim(void)
   	return z;
 }
 
+// Saves a pool, then maps it back in both modes, the live objects must be the same
+bool snapshotRoundTrip(MemoryPool<int>& pool, const char* path)
+{
+	long long before = 0;
+	pool.forEach([&](int& e){ before += e; });
+	if(!pool.save(path))
+	{
+		return false;
+	}
+	
+	bool same = true;
+	for(SnapshotMode mode : {SnapshotMode::copyOnWrite, SnapshotMode::readOnly})
+	{
+		MemoryPool<int> restored(pool.getCapacity());
+		long long after = 0;
+		same = same && restored.restore(path, mode) && restored.getSize() == pool.getSize();
+		restored.forEach([&](int& e){ after += e; });
+		same = same && after == before;
+	}
+	std::remove(path);
+	return same;
+}
+
+// Releasing the block the bump pointer is in must leave the pool walkable
+bool trimThenForEach()
+{
+	MemoryPool<int> pool(4);
+	std::vector<int*> ptrs;
+	for(int i = 0; i < 8; ++i)
+	{
+		ptrs.push_back(pool.emplace(i));
+	}
+	for(int i = 4; i < 8; ++i)
+	{
+		pool.remove(ptrs[i]);
+	}
+	
+	int count = 0;
+	int sum = 0;
+	bool released = pool.trim() == 1;
+	pool.forEach([&](int& e){ ++count; sum += e; });
+	return released && count == 4 && sum == 6;
+}
+
 void launchTest()
 {
 	for(size_t i = 0; i < 100000; i++)
@@ -98,6 +144,13 @@ int main(int argc, char* argv[])
    	std::chrono::duration<double> dur2 = end - begin;
    	std::cout << "First = " << dur1.count() << std::endl;
    	std::cout << "Second = " << dur2.count() << std::endl;
+   	
+   	for(size_t i = 0; i < 10000; i += 7)
+   	{
+   		newPool.remove(&newPool[i]);
+   	}
+   	std::cout << "Trim then forEach = " << (trimThenForEach() ? "ok" : "failed") << std::endl;
+   	std::cout << "Snapshot round trip = " << (snapshotRoundTrip(newPool, "tst.pool") ? "ok" : "failed") << std::endl;
   	return 0;
 }
 